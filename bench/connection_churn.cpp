@@ -0,0 +1,129 @@
+/* This file is part of FlowCanvas.
+ * Copyright (C) 2007-2009 David Robillard <http://drobilla.net>
+ *
+ * FlowCanvas is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * FlowCanvas is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+/** Count heap allocations per connect and disconnect.
+ *
+ * Connects and disconnects N_PORTS pairs of ports N_ROUNDS times, after a
+ * warm up, and prints the mean number of calls to malloc, calloc and realloc
+ * for each connect and disconnect pair.  The connection pool is enabled
+ * unless the program is run with --no-pool.  Needs glibc (malloc is counted
+ * by wrapping __libc_malloc) and a display.
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include <gtkmm/main.h>
+
+#include "flowcanvas/Canvas.hpp"
+#include "flowcanvas/Module.hpp"
+#include "flowcanvas/Port.hpp"
+
+using namespace FlowCanvas;
+
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t n, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+}
+
+static volatile size_t n_allocations = 0;
+
+extern "C" void*
+malloc(size_t size)
+{
+	__sync_fetch_and_add(&n_allocations, 1);
+	return __libc_malloc(size);
+}
+
+extern "C" void*
+calloc(size_t n, size_t size)
+{
+	__sync_fetch_and_add(&n_allocations, 1);
+	return __libc_calloc(n, size);
+}
+
+extern "C" void*
+realloc(void* ptr, size_t size)
+{
+	__sync_fetch_and_add(&n_allocations, 1);
+	return __libc_realloc(ptr, size);
+}
+
+typedef std::vector< boost::shared_ptr<Port> > Ports;
+
+static const size_t N_PORTS  = 256;
+static const size_t N_ROUNDS = 64;
+
+static void
+churn(boost::shared_ptr<Canvas> canvas, const Ports& outs, const Ports& ins)
+{
+	for (size_t i = 0; i < outs.size(); ++i)
+		canvas->add_connection(outs[i], ins[i], 0x666666FF);
+
+	for (size_t i = 0; i < outs.size(); ++i)
+		canvas->remove_connection(outs[i], ins[i]);
+
+	// Run deferred connection updates
+	while (Gtk::Main::events_pending())
+		Gtk::Main::iteration(false);
+}
+
+int
+main(int argc, char** argv)
+{
+	Gtk::Main kit(argc, argv);
+
+	const bool pool = !(argc > 1 && !strcmp(argv[1], "--no-pool"));
+
+	boost::shared_ptr<Canvas> canvas(new Canvas(1600, 1200));
+	if (pool)
+		canvas->set_connection_pool_size(N_PORTS);
+
+	boost::shared_ptr<Module> tail(new Module(canvas, "tail", 100, 100));
+	boost::shared_ptr<Module> head(new Module(canvas, "head", 600, 100));
+	canvas->add_item(tail);
+	canvas->add_item(head);
+
+	Ports outs;
+	Ports ins;
+	for (size_t i = 0; i < N_PORTS; ++i) {
+		char name[16];
+		snprintf(name, sizeof(name), "p%zu", i);
+		outs.push_back(boost::shared_ptr<Port>(new Port(tail, name, false, 0x4A8A0EFF)));
+		ins.push_back(boost::shared_ptr<Port>(new Port(head, name, true, 0x4A8A0EFF)));
+		tail->add_port(outs.back());
+		head->add_port(ins.back());
+	}
+
+	// Fill the pool and let containers reach their final size
+	churn(canvas, outs, ins);
+	churn(canvas, outs, ins);
+
+	const size_t before = n_allocations;
+	for (size_t r = 0; r < N_ROUNDS; ++r)
+		churn(canvas, outs, ins);
+	const size_t after = n_allocations;
+
+	printf("%s: %.2f allocations per connect and disconnect\n",
+	       pool ? "pooled" : "unpooled",
+	       double(after - before) / (N_ROUNDS * N_PORTS));
+
+	canvas->destroy();
+	return 0;
+}
@@ -0,0 +1,88 @@
+/* This file is part of FlowCanvas.
+ * Copyright (C) 2007-2009 David Robillard <http://drobilla.net>
+ *
+ * FlowCanvas is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * FlowCanvas is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+/** Time Connection::update_location() as a drag does.
+ *
+ * Connects N_PORTS ports of one module to another module, and N_PORTS
+ * ellipses to each other, then moves the first module and ellipse N_MOVES
+ * times, one canvas update per move, so every connection is routed again
+ * each time.  Prints the mean time per connection update.  Run it on two
+ * builds to compare them.  Needs a display.
+ */
+
+#include <cstdio>
+#include <vector>
+
+#include <glibmm/timer.h>
+#include <gtkmm/main.h>
+
+#include "flowcanvas/Canvas.hpp"
+#include "flowcanvas/Ellipse.hpp"
+#include "flowcanvas/Module.hpp"
+#include "flowcanvas/Port.hpp"
+
+using namespace FlowCanvas;
+
+static const size_t N_PORTS = 256;
+static const size_t N_MOVES = 1000;
+
+int
+main(int argc, char** argv)
+{
+	Gtk::Main kit(argc, argv);
+
+	boost::shared_ptr<Canvas> canvas(new Canvas(1600, 1200));
+
+	boost::shared_ptr<Module> tail(new Module(canvas, "tail", 100, 100));
+	boost::shared_ptr<Module> head(new Module(canvas, "head", 600, 100));
+	canvas->add_item(tail);
+	canvas->add_item(head);
+
+	boost::shared_ptr<Ellipse> hub(new Ellipse(canvas, "hub", 300, 800, 20, 20));
+	canvas->add_item(hub);
+
+	for (size_t i = 0; i < N_PORTS; ++i) {
+		char name[16];
+		snprintf(name, sizeof(name), "p%zu", i);
+		boost::shared_ptr<Port> out(new Port(tail, name, false, 0x4A8A0EFF));
+		boost::shared_ptr<Port> in(new Port(head, name, true, 0x4A8A0EFF));
+		tail->add_port(out);
+		head->add_port(in);
+		canvas->add_connection(out, in, 0x666666FF);
+
+		boost::shared_ptr<Ellipse> e(new Ellipse(canvas, name,
+				100 + (i % 32) * 40, 900 + (i / 32) * 40, 10, 10));
+		canvas->add_item(e);
+		canvas->add_connection(hub, e, 0x666666FF);
+	}
+
+	Glib::Timer timer;
+	for (size_t i = 0; i < N_MOVES; ++i) {
+		Canvas::ScopedUpdate update(*canvas);
+		const double d = (i % 2) ? -1.0 : 1.0;
+		tail->move(d, 0);
+		hub->move(d, 0);
+	}
+	timer.stop();
+
+	const double n_updates = double(N_MOVES) * N_PORTS * 2;
+	printf("%.3f us per connection update (%zu moves of %zu connections)\n",
+	       timer.elapsed() * 1e6 / n_updates, N_MOVES, N_PORTS * 2);
+
+	canvas->destroy();
+	return 0;
+}
@@ -20,14 +20,20 @@
 
 #include <list>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include <boost/enable_shared_from_this.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/unordered_set.hpp>
 #include <boost/utility.hpp>
 
 #include <libgnomecanvasmm.h>
 
 #include "flowcanvas/Connection.hpp"
 #include "flowcanvas/Item.hpp"
+#include "flowcanvas/LayoutEngine.hpp"
 #include "flowcanvas/Module.hpp"
 
 
@@ -39,7 +45,11 @@ namespace FlowCanvas {
 
 class Port;
 class Module;
-class GVNodes;
+class ArrangeJob;
+class DotSession;
+class ForceLayout;
+struct LayoutGraph;
+template <typename T> class SpatialIndex;
 
 
 /** \defgroup FlowCanvas FlowCanvas
@@ -81,29 +91,72 @@ public:
 	boost::shared_ptr<Connection> remove_connection(boost::shared_ptr<Connectable> tail,
 	                                                boost::shared_ptr<Connectable> head);
 
+	void   set_connection_pool_size(size_t n);
+	size_t connection_pool_size() const { return _connection_pool_size; }
+
 	void set_default_placement(boost::shared_ptr<Module> m);
 
+	/** Place new modules near what they connect to (see set_default_placement()). */
+	void set_incremental_placement(bool b) { _incremental_placement = b; }
+	bool incremental_placement() const     { return _incremental_placement; }
+
 	void clear_selection();
 	void select_item(boost::shared_ptr<Item> item);
 	void unselect_ports();
 	void unselect_item(boost::shared_ptr<Item> item);
 	void unselect_connection(Connection* c);
 
+	boost::shared_ptr<Item>       get_item(ItemId id) const             { return _item_slots.get(id); }
+	boost::shared_ptr<Port>       get_port(PortId id) const             { return _port_slots.get(id).lock(); }
+	boost::shared_ptr<Connection> get_connection(ConnectionId id) const { return _connection_slots.get(id); }
+
 	ItemList&       items()                { return _items; }
-	ItemList&       selected_items()       { return _selected_items; }
+	ItemSet&        selected_items()       { return _selected_items; }
 	ConnectionList& connections()          { return _connections; }
-	ConnectionList& selected_connections() { return _selected_connections; }
+	ConnectionSet&  selected_connections() { return _selected_connections; }
+
+	const ConnectionSet& item_connections(boost::shared_ptr<const Item> item) const;
+
+	void item_bounds_changed(Item* item);
+	void connection_bounds_changed(Connection* c, double x1, double y1, double x2, double y2);
 
 	void lock(bool l);
 	bool locked() const { return _locked; }
 
+	/** Highlight items inside the selection rectangle while dragging it. */
+	void set_live_select(bool b) { _live_select = b; }
+	bool live_select() const     { return _live_select; }
+
 	double get_zoom() { return _zoom; }
 	void   set_zoom(double pix_per_unit);
 	void   zoom_full();
 
+	void        set_detail_thresholds(double reduced, double minimal);
+	DetailLevel detail_level() const { return _detail; }
+
+	/** Hide items and connections outside the visible area (see set_culling()). */
+	void set_culling(bool b);
+	bool culling() const { return _culling; }
+
 	void render_to_dot(const std::string& filename);
 	virtual void arrange(bool use_length_hints=false, bool center=true);
 
+	void         set_layout_engine(LayoutEngine e) { _layout_engine = e; }
+	LayoutEngine layout_engine() const             { return _layout_engine; }
+
+	/** Arrange in the background, without blocking the GUI.
+	 *
+	 * The layout is computed in another thread from a copy of the graph,
+	 * and applied all at once when it is done (anything added meanwhile is
+	 * left where it is).  Starting another arrange cancels this one.
+	 */
+	void arrange_async(bool use_length_hints=false, bool center=true);
+	void cancel_arrange();
+	bool arranging() const { return _arrange_job || _force_layout; }
+
+	sigc::signal<void, double> signal_arrange_progress; ///< Fraction done
+	sigc::signal<void, bool>   signal_arrange_finished; ///< False if cancelled
+
 	void move_contents_to(double x, double y);
 
 	double width() const  { return _width; }
@@ -112,6 +165,19 @@ public:
 	void resize(double width, double height);
 	void resize_all_items();
 
+	void begin_update();
+	void end_update();
+	bool updating() const { return _update_depth > 0; }
+
+	/** Batches canvas changes for its lifetime (see begin_update()). */
+	class ScopedUpdate : boost::noncopyable {
+	public:
+		explicit ScopedUpdate(Canvas& canvas) : _canvas(canvas) { _canvas.begin_update(); }
+		~ScopedUpdate() { _canvas.end_update(); }
+	private:
+		Canvas& _canvas;
+	};
+
 	void scroll_to_center();
 
 	enum FlowDirection {
@@ -119,11 +185,12 @@ public:
 		VERTICAL
 	};
 
-	void set_direction(FlowDirection d) { _direction = d; }
-	FlowDirection direction() const     { return _direction; }
+	void          set_direction(FlowDirection d);
+	FlowDirection direction() const { return _direction; }
 
 	/** Dash applied to selected items.
-	 * Set an object's property_dash() to this for the "rubber band" effect */
+	 * Set an object's property_dash() to this to mark an object selected.
+	 * The selection as a whole is framed by a single animated overlay. */
 	ArtVpathDash* select_dash() { return _select_dash; }
 
 	/** Make a connection.  Should be overridden by an implementation to do something. */
@@ -140,22 +207,59 @@ public:
 protected:
 	ItemList                                   _items;  ///< All items on this canvas
 	ConnectionList                             _connections;  ///< All connections on this canvas
-	std::list< boost::shared_ptr<Item> >       _selected_items;  ///< All currently selected modules
-	std::list< boost::shared_ptr<Connection> > _selected_connections;  ///< All currently selected connections
+	ItemSet                                    _selected_items;  ///< All currently selected modules
+	ConnectionSet                              _selected_connections;  ///< All currently selected connections
 
 	virtual bool canvas_event(GdkEvent* event);
 	virtual bool frame_event(GdkEvent* ev);
 
 private:
+	friend class Connection;
 	friend class Module;
 	bool port_event(GdkEvent* event, boost::weak_ptr<Port> port);
 
-	GVNodes layout_dot(bool use_length_hints, const std::string& filename);
+	void build_layout_graph(LayoutGraph& graph, bool use_length_hints) const;
+	void apply_layout(const LayoutGraph& graph, bool center);
+	void on_arrange_progress();
+	void on_arrange_done();
+	void abandon_arrange();
+	bool animate_layout();
+
+	bool place_new_modules();
+	void place_module(boost::shared_ptr<Module> m, double x, double y);
+	bool placement_near_neighbours(boost::shared_ptr<Module> m, double& x, double& y) const;
 
 	void remove_connection(boost::shared_ptr<Connection> c);
 	bool are_connected(boost::shared_ptr<const Connectable> tail,
 	                   boost::shared_ptr<const Connectable> head);
 
+	/** Endpoint pair (tail, head) used as a key to find connections. */
+	typedef std::pair<const Connectable*, const Connectable*> ConnectionKey;
+
+	/** Index of _connections by endpoints, for constant time lookup.
+	 * Every connection in _connections has exactly one entry. */
+	typedef boost::unordered_multimap< ConnectionKey,
+	                                   ConnectionList::iterator,
+	                                   boost::hash<ConnectionKey> > ConnectionIndex;
+
+	ConnectionIndex::const_iterator find_connection(const Connectable* tail,
+	                                                const Connectable* head) const;
+
+	void index_connection(ConnectionList::iterator i);
+	ConnectionIndex::iterator find_index_entry(boost::shared_ptr<Connection> connection);
+
+	struct RecycleConnection;
+	void recycle_connection(Connection* c);
+
+	/** Connections incident to each item (including those of a module's ports). */
+	typedef boost::unordered_map<const Item*, ConnectionSet> Adjacency;
+
+	void add_adjacency(boost::shared_ptr<Connection> c);
+	void remove_adjacency(boost::shared_ptr<Connection> c);
+
+	void register_port(boost::shared_ptr<Port> port);
+	void unregister_port(Port* port);
+
 	void select_port(boost::shared_ptr<Port> p, bool unique = false);
 	void select_port_toggle(boost::shared_ptr<Port> p, int mod_state);
 	void unselect_port(boost::shared_ptr<Port> p);
@@ -166,27 +270,105 @@ private:
 
 	bool scroll_drag_handler(GdkEvent* event);
 	bool select_drag_handler(GdkEvent* event);
+	void update_select_preview(double x1, double y1, double x2, double y2);
+	void clear_select_preview();
 	bool connection_drag_handler(GdkEvent* event);
 
 	void ports_joined(boost::shared_ptr<Port> port1, boost::shared_ptr<Port> port2);
 	bool animate_selected();
+	void selection_changed();
+	void update_select_animation();
 
 	void move_contents_to_internal(double x, double y, double min_x, double min_y);
 
+	bool defer_resize(Module* module);
+	void defer_update_location(Connection* connection);
+	bool update_connections();
+	void forget_updates(Module* module);
+	void forget_updates(Connection* connection);
+	void apply_size();
+	DetailLevel apply_detail();
+
 	void on_parent_changed(Gtk::Widget* old_parent);
 	sigc::connection _parent_event_connection;
 
-	typedef std::list< boost::shared_ptr<Port> > SelectedPorts;
-
+	bool in_view(double x1, double y1, double x2, double y2) const;
+	void set_shown(Item* item, bool shown);
+	void set_shown(Connection* connection, bool shown);
+	void queue_cull();
+	void on_size_allocated(Gtk::Allocation& allocation);
+	bool cull();
+
+	sigc::connection _hadjustment_connection;
+	sigc::connection _vadjustment_connection;
+	sigc::connection _cull_idle;
+	sigc::connection _animate_timeout;
+
+	ArrangeJob*      _arrange_job;  ///< Background arrange in progress
+	ForceLayout*     _force_layout; ///< Animated arrange in progress
+	DotSession*      _dot_session;  ///< Graphviz graphs from the last arrange
+	sigc::connection _force_timeout;
+
+	/* Modules waiting to be placed (after their connections are made).
+	 * Those in _unplaced_modules do not count as neighbours for placement. */
+	typedef std::vector<boost::weak_ptr<Module> > NewModules;
+	typedef boost::unordered_set<const Item*>     UnplacedModules;
+	NewModules       _new_modules;
+	UnplacedModules  _unplaced_modules;
+	sigc::connection _place_idle;
+
+	/** Selected ports, mapped to the order they were selected in. */
+	typedef boost::unordered_map<boost::shared_ptr<Port>, unsigned> SelectedPorts;
+
+	/* Contiguous storage behind the ids of everything on the canvas, which
+	 * is also used for iteration where order does not matter. */
+	SlotMap<Item>                          _item_slots;
+	SlotMap<Port, boost::weak_ptr<Port> >  _port_slots;
+	SlotMap<Connection>                    _connection_slots;
+
+	std::vector<Connection*> _spare_connections; ///< Removed connections for reuse
+	size_t                   _connection_pool_size; ///< Maximum size of _spare_connections
+
+	ConnectionIndex         _connection_index; ///< _connections by endpoints
+	Adjacency               _adjacency; ///< _connections by incident item
 	SelectedPorts           _selected_ports; ///< Selected ports (hilited red)
+	unsigned                _port_select_count; ///< Ports selected so far, for ordering
 	boost::shared_ptr<Port> _connect_port;  ///< Port for which a connection is being made
 	boost::shared_ptr<Port> _last_selected_port;
 
+	SpatialIndex<Item>*       _item_index;        ///< Bounding boxes of _items
+	SpatialIndex<Connection>* _connection_bounds; ///< Bounding boxes of _connections
+
+	/* Items and connections not hidden by culling.  While culling, anything
+	 * on the canvas is visible if and only if it is in one of these. */
+	typedef boost::unordered_set<Item*>       ShownItems;
+	typedef boost::unordered_set<Connection*> ShownConnections;
+	ShownItems       _shown_items;
+	ShownConnections _shown_connections;
+
+	double _view_x1, _view_y1, _view_x2, _view_y2; ///< Culling area (world)
+
+	typedef boost::unordered_set<Item*> SelectPreview;
+	SelectPreview        _select_preview; ///< Items highlighted by live select
+
+	typedef boost::unordered_set<Module*>     DirtyModules;
+	typedef boost::unordered_set<Connection*> DirtyConnections;
+
+	unsigned         _update_depth;      ///< Nesting depth of begin_update()
+	DirtyModules     _dirty_modules;     ///< Modules to resize at end_update()
+	DirtyConnections _dirty_connections; ///< Connections to reroute before drawing
+	sigc::connection _update_connections_idle;
+
 	Gnome::Canvas::Rect  _base_rect;   ///< Background
 	Gnome::Canvas::Rect* _select_rect; ///< Rectangle for drag selection
+	Gnome::Canvas::Rect* _select_frame; ///< Animated frame around selection
 	ArtVpathDash*        _select_dash; ///< Animated selection dash style
 
 	double _zoom;   ///< Current zoom level
+	double _reduced_detail_zoom; ///< Zoom below which detail is reduced
+	double _minimal_detail_zoom; ///< Zoom below which detail is minimal
+
+	DetailLevel _detail; ///< Current detail level, from _zoom
 	double _width;
 	double _height;
 
@@ -194,9 +376,16 @@ private:
 	DragState      _drag_state;
 
 	FlowDirection _direction;
+	LayoutEngine  _layout_engine;
 
 	bool _remove_objects :1; // flag to avoid removing objects from destructors when unnecessary
 	bool _locked         :1;
+	bool _live_select    :1;
+	bool _resize_pending :1; ///< Size changed during an update
+	bool _select_frame_dirty :1; ///< Selection bounds changed since last tick
+	bool _incremental_placement :1;
+	bool _resizing_items :1; ///< Resizing dirty modules in end_update()
+	bool _culling        :1;
 };
 
 
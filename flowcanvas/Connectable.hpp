@@ -18,9 +18,13 @@
 #ifndef FLOWCANVAS_CONNECTABLE_HPP
 #define FLOWCANVAS_CONNECTABLE_HPP
 
-#include <list>
+#include <cstddef>
+#include <vector>
 
+#include <boost/scoped_ptr.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/weak_ptr.hpp>
 
 namespace FlowCanvas {
 
@@ -45,11 +49,27 @@ public:
 
 	bool is_connected_to(boost::shared_ptr<Connectable> other);
 
-	typedef std::list< boost::weak_ptr<Connection> > Connections;
-	Connections& connections() { return _connections; }
+	typedef std::vector< boost::weak_ptr<Connection> > Connections;
+	const Connections& connections() const { return _connections; }
 
 protected:
+	void clear_connections();
+
 	Connections _connections; ///< needed for dragging
+
+private:
+	/** Connections are indexed by address once there are more than this. */
+	static const size_t INDEX_THRESHOLD = 16;
+
+	typedef boost::unordered_map<const Connection*, size_t> Positions;
+
+	size_t find_connection(const Connection* c) const;
+	void   erase_connection(size_t i);
+	void   index_connections();
+	void   compact_connections();
+
+	std::vector<const Connection*> _addresses; ///< Address of each of _connections
+	boost::scoped_ptr<Positions>   _positions; ///< Index of _connections, if large
 };
 
 
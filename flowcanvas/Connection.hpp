@@ -23,16 +23,25 @@
 #include <list>
 #include <string>
 
+#include <boost/shared_ptr.hpp>
+#include <boost/unordered_set.hpp>
 #include <boost/weak_ptr.hpp>
 
 #include <libgnomecanvasmm.h>
 #include <libgnomecanvasmm/bpath.h>
 #include <libgnomecanvasmm/path-def.h>
 
+#include "flowcanvas/DetailLevel.hpp"
+#include "flowcanvas/SlotMap.hpp"
+
 namespace FlowCanvas {
 
 class Canvas;
 class Connectable;
+class Connection;
+class Item;
+
+typedef SlotId<Connection> ConnectionId;
 
 
 /** A connection (line) between two canvas objects.
@@ -54,6 +63,10 @@ public:
 	{ /* ignore, src/dst take care of it */ }
 
 	virtual void zoom(double z);
+	void         set_detail(DetailLevel level);
+
+	/** Id of this connection on its canvas (null if not on the canvas). */
+	ConnectionId id() const { return _id; }
 
 	bool selected() const { return _selected; }
 	void set_selected(bool b);
@@ -84,10 +97,28 @@ protected:
 	friend class Canvas;
 	friend class Connectable;
 	void update_location();
+	void update_path();
 
-	const boost::weak_ptr<Canvas>      _canvas;
-	const boost::weak_ptr<Connectable> _source;
-	const boost::weak_ptr<Connectable> _dest;
+	void set_endpoints(boost::shared_ptr<Connectable> source,
+	                   boost::shared_ptr<Connectable> dest);
+
+	void reset(boost::shared_ptr<Connectable> source,
+	           boost::shared_ptr<Connectable> dest,
+	           uint32_t                       color);
+	void recycle();
+
+	const boost::weak_ptr<Canvas> _canvas;
+	boost::weak_ptr<Connectable>  _source;
+	boost::weak_ptr<Connectable>  _dest;
+	ConnectionId                  _id;
+
+	/* Endpoint classification, computed once by set_endpoints() so hot
+	 * paths need no RTTI.  The items are the endpoints themselves, or the
+	 * modules of Port endpoints, and are only to be dereferenced while the
+	 * endpoint is locked.
+	 */
+	FlowCanvas::Item* _source_item;
+	FlowCanvas::Item* _dest_item;
 
 	Gnome::Canvas::Bpath _bpath;
 	GnomeCanvasPathDef*  _path;
@@ -103,12 +134,17 @@ protected:
 
 	uint32_t    _color;
 	HandleStyle _handle_style;
+	DetailLevel _detail;
 
 	bool _selected       :1;
 	bool _show_arrowhead :1;
+	bool _straight       :1; ///< An endpoint is an Ellipse
+	bool _source_is_item :1; ///< Source is _source_item (not a Port on it)
+	bool _dest_is_item   :1; ///< Dest is _dest_item (not a Port on it)
 };
 
 typedef std::list<boost::shared_ptr<Connection> > ConnectionList;
+typedef boost::unordered_set<boost::shared_ptr<Connection> > ConnectionSet;
 
 
 } // namespace FlowCanvas
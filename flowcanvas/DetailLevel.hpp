@@ -0,0 +1,38 @@
+/* This file is part of FlowCanvas.
+ * Copyright (C) 2007-2009 David Robillard <http://drobilla.net>
+ *
+ * FlowCanvas is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * FlowCanvas is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#ifndef FLOWCANVAS_DETAILLEVEL_HPP
+#define FLOWCANVAS_DETAILLEVEL_HPP
+
+namespace FlowCanvas {
+
+
+/** How much of the canvas contents to draw, chosen by zoom level.
+ *
+ * \see Canvas::set_detail_thresholds
+ * \ingroup FlowCanvas
+ */
+enum DetailLevel {
+	DETAIL_FULL,    ///< Everything
+	DETAIL_REDUCED, ///< No text or control gauges, ports are plain rects
+	DETAIL_MINIMAL  ///< Modules are plain boxes, connections straight lines
+};
+
+
+} // namespace FlowCanvas
+
+#endif // FLOWCANVAS_DETAILLEVEL_HPP
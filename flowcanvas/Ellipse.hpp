@@ -62,7 +62,10 @@ public:
 
 	bool point_is_within(double x, double y);
 
+	void world_bounds(double& x1, double& y1, double& x2, double& y2) const;
+
 	void zoom(double z);
+	void set_detail(DetailLevel level);
 	void resize();
 
 	virtual void move(double dx, double dy);
@@ -90,6 +93,7 @@ public:
 
 protected:
 	bool is_within(const Gnome::Canvas::Rect& rect);
+	void bounds_changed();
 
 	double _border_width;
 	bool   _title_visible;
@@ -25,14 +25,20 @@
 
 #include <boost/enable_shared_from_this.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/unordered_set.hpp>
 
 #include <libgnomecanvasmm.h>
 
+#include "flowcanvas/DetailLevel.hpp"
 #include "flowcanvas/Port.hpp"
+#include "flowcanvas/SlotMap.hpp"
 
 namespace FlowCanvas {
 
 class Canvas;
+class Item;
+
+typedef SlotId<Item> ItemId;
 
 
 /** An item on a Canvas.
@@ -51,9 +57,14 @@ public:
 
 	virtual ~Item() {}
 
+	/** Id of this item on its canvas (null if not on the canvas). */
+	ItemId id() const { return _id; }
+
 	bool selected() const { return _selected; }
 	virtual void set_selected(bool s);
 
+	virtual void set_highlighted(bool b) {}
+
 	virtual void set_minimum_width(double w) { _minimum_width = w; }
 
 	virtual void select_tick() = 0;
@@ -61,6 +72,7 @@ public:
 	virtual void move(double dx, double dy) = 0;
 
 	virtual void zoom(double z) {}
+	virtual void set_detail(DetailLevel level) {}
 	boost::weak_ptr<Canvas> canvas() const { return _canvas; }
 
 	bool popup_menu(guint button, guint32 activate_time) {
@@ -90,6 +102,8 @@ public:
 	bool        is_within(const Gnome::Canvas::Rect& rect) const;
 	inline bool point_is_within(double x, double y) const;
 
+	virtual void world_bounds(double& x1, double& y1, double& x2, double& y2) const;
+
 	const std::string& name() const                   { return _name; }
 	virtual void       set_name(const std::string& n) { _name = n; }
 
@@ -121,6 +135,8 @@ public:
 	sigc::signal<void, double, double> signal_dropped;
 
 protected:
+	friend class Canvas;
+
 	virtual void on_drag(double dx, double dy);
 	virtual void on_drop();
 	virtual void on_click(GdkEventButton* ev);
@@ -135,6 +151,7 @@ protected:
 
 	boost::weak_ptr<Item> _partner;
 
+	ItemId      _id;
 	Gtk::Menu*  _menu;
 	std::string _name;
 	double      _minimum_width;
@@ -147,6 +164,19 @@ protected:
 
 
 typedef std::list<boost::shared_ptr<Item> > ItemList;
+typedef boost::unordered_set<boost::shared_ptr<Item> > ItemSet;
+
+
+/** Get the bounding box of the item (in world units).
+ */
+inline void
+Item::world_bounds(double& x1, double& y1, double& x2, double& y2) const
+{
+	x1 = property_x();
+	y1 = property_y();
+	x2 = x1 + _width;
+	y2 = y1 + _height;
+}
 
 
 /** Returns whether or not the point @a x, @a y (world units) is within the item.
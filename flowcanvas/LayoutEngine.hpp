@@ -0,0 +1,41 @@
+/* This file is part of FlowCanvas.
+ * Copyright (C) 2007-2009 David Robillard <http://drobilla.net>
+ *
+ * FlowCanvas is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * FlowCanvas is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#ifndef FLOWCANVAS_LAYOUTENGINE_HPP
+#define FLOWCANVAS_LAYOUTENGINE_HPP
+
+namespace FlowCanvas {
+
+
+/** How to lay out the canvas when arranging.
+ *
+ * Separate groups of connected items are laid out in parallel, except with
+ * graphviz, which only does one layout at a time in the whole process.
+ *
+ * \see Canvas::set_layout_engine
+ * \ingroup FlowCanvas
+ */
+enum LayoutEngine {
+	LAYOUT_DOT,     ///< Graphviz dot if available, otherwise LAYOUT_LAYERED
+	LAYOUT_LAYERED, ///< Built in layered layout, in the direction of flow
+	LAYOUT_FORCE    ///< Force directed, for densely connected graphs
+};
+
+
+} // namespace FlowCanvas
+
+#endif // FLOWCANVAS_LAYOUTENGINE_HPP
@@ -18,9 +18,13 @@
 #ifndef FLOWCANVAS_MODULE_HPP
 #define FLOWCANVAS_MODULE_HPP
 
+#include <cstring>
+#include <map>
 #include <string>
 #include <algorithm>
+#include <boost/functional/hash.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/unordered_map.hpp>
 #include <libgnomecanvasmm.h>
 #include "flowcanvas/Port.hpp"
 #include "flowcanvas/Item.hpp"
@@ -50,12 +54,14 @@ public:
 	PortVector&       ports()       { return _ports; }
 
 	inline boost::shared_ptr<Port> get_port(const std::string& name) const;
+	inline boost::shared_ptr<Port> get_port(const char* name) const;
 
 	void                    add_port(boost::shared_ptr<Port> port);
 	void                    remove_port(boost::shared_ptr<Port> port);
 	boost::shared_ptr<Port> port_at(double x, double y);
 
 	void zoom(double z);
+	void set_detail(DetailLevel level);
 	void resize();
 
 	bool show_port_labels(bool b) { return _show_port_labels; }
@@ -91,6 +97,7 @@ protected:
 	virtual void set_height(double h);
 
 	void fit_canvas();
+	void refresh_bounds();
 	void measure_ports();
 	void resize_horiz();
 	void resize_vert();
@@ -119,22 +126,91 @@ protected:
 	bool   _title_visible    :1;
 	bool   _port_renamed     :1;
 	bool   _show_port_labels :1;
+	bool   _ports_moved      :1;
 
 private:
 	friend class Canvas;
 
-	struct PortComparator {
-		explicit PortComparator(const std::string& name) : _name(name) {}
-		inline bool operator()(const boost::shared_ptr<Port> port)
-			{ return (port && port->name() == _name); }
-		const std::string& _name;
+	/** Hash for port names which accepts C strings without copying. */
+	struct PortNameHash {
+		inline size_t operator()(const std::string& name) const
+			{ return boost::hash_range(name.begin(), name.end()); }
+		inline size_t operator()(const char* name) const
+			{ return boost::hash_range(name, name + strlen(name)); }
 	};
 
+	/** Equality for port names which accepts C strings without copying. */
+	struct PortNameEqual {
+		inline bool operator()(const std::string& a, const std::string& b) const
+			{ return a == b; }
+		inline bool operator()(const char* a, const std::string& b) const
+			{ return b == a; }
+		inline bool operator()(const std::string& a, const char* b) const
+			{ return a == b; }
+	};
+
+	typedef boost::unordered_map<std::string, boost::shared_ptr<Port>,
+	                             PortNameHash, PortNameEqual> PortsByName;
+
+	typedef boost::unordered_map<const Port*, std::string> PortNames;
+
+	/** Port along the flow-perpendicular axis, keyed by its leading edge. */
+	typedef std::vector< std::pair<double, boost::shared_ptr<Port> > > PortPositions;
+
+	struct PortPositionLess {
+		inline bool operator()(double a, const PortPositions::value_type& b) const
+			{ return a < b.first; }
+		inline bool operator()(const PortPositions::value_type& a,
+		                       const PortPositions::value_type& b) const
+			{ return a.first < b.first; }
+	};
+
+	void index_port_positions(bool horizontal);
+
+	PortPositions _port_positions; ///< Ports sorted by position, for port_at
+	double        _port_extent;    ///< Largest port extent along that axis
+
+	void index_port(boost::shared_ptr<Port> port);
+	void unindex_port(boost::shared_ptr<Port> port);
+	void on_port_renamed(boost::weak_ptr<Port> port);
+
+	/** Number of ports of each width, so the widest is known in log time. */
+	typedef std::map<double, unsigned> PortWidths;
+
+	typedef boost::unordered_map<const Port*, double> PortWidthsByPort;
+
+	void count_port_width(boost::shared_ptr<Port> port);
+	void uncount_port_width(boost::shared_ptr<Port> port);
+	void update_widest();
+
+	/** Position a port was last placed at by a resize. */
+	struct PortPlacement {
+		PortPlacement() : x(0.0), y(0.0), placed(false) {}
+		PortPlacement(double px, double py) : x(px), y(py), placed(true) {}
+		double x;
+		double y;
+		bool   placed;
+	};
+
+	typedef std::vector<PortPlacement> PortPlacements;
+
+	bool place_port(size_t index, double x, double y, double width, double height);
+
+	PortPlacements _port_placements; ///< Placement of each of _ports
+
+	PortWidths       _input_widths;  ///< Natural widths of inputs
+	PortWidths       _output_widths; ///< Natural widths of outputs
+	PortWidthsByPort _port_widths;   ///< Width each port is counted under
+
+	PortsByName _ports_by_name; ///< Index of _ports by name
+	PortNames   _port_names;    ///< Name each port is indexed under
+
+	std::vector<sigc::connection> _port_renamed_connections; ///< For each of _ports
+
 	void embed_size_request(Gtk::Requisition* req, bool force);
 };
 
 
-
 // Performance critical functions:
 
 
@@ -142,9 +218,18 @@ private:
 inline boost::shared_ptr<Port>
 Module::get_port(const std::string& port_name) const
 {
-	PortComparator comp(port_name);
-	PortVector::const_iterator i = std::find_if(_ports.begin(), _ports.end(), comp);
-	return (i != _ports.end()) ? *i : boost::shared_ptr<Port>();
+	PortsByName::const_iterator i = _ports_by_name.find(port_name);
+	return (i != _ports_by_name.end()) ? i->second : boost::shared_ptr<Port>();
+}
+
+
+/** Find a port on this module (without constructing a std::string). */
+inline boost::shared_ptr<Port>
+Module::get_port(const char* port_name) const
+{
+	PortsByName::const_iterator i = _ports_by_name.find(
+		port_name, PortNameHash(), PortNameEqual());
+	return (i != _ports_by_name.end()) ? i->second : boost::shared_ptr<Port>();
 }
 
 
@@ -31,11 +31,16 @@
 #include <libgnomecanvasmm.h>
 
 #include "flowcanvas/Connectable.hpp"
+#include "flowcanvas/DetailLevel.hpp"
+#include "flowcanvas/SlotMap.hpp"
 
 namespace FlowCanvas {
 
 class Connection;
 class Module;
+class Port;
+
+typedef SlotId<Port> PortId;
 
 
 static const int PORT_LABEL_SIZE = 8000; // in thousandths of a point
@@ -63,8 +68,14 @@ public:
 	virtual Gnome::Art::Point dst_connection_point(const Gnome::Art::Point& src);
 	virtual Gnome::Art::Point connection_point_vector(double dx, double dy);
 
+	virtual void move_connections();
+	void         module_moved(double dx, double dy);
+
 	boost::weak_ptr<Module> module() const { return _module; }
 
+	/** Id of this port on its canvas (null if not on the canvas). */
+	PortId id() const { return _id; }
+
 	void set_fill_color(uint32_t c) { _rect->property_fill_color_rgba() = c; }
 
 	void show_label(bool b);
@@ -77,6 +88,7 @@ public:
 	                     bool raise_connections=true);
 
 	void zoom(float z);
+	void set_detail(DetailLevel level);
 
 	void popup_menu(guint button, guint32 activate_time) {
 		if ( ! _menu)
@@ -132,7 +144,14 @@ protected:
 
 	void on_menu_hide();
 
+	void update_connection_point();
+
+	/** Forget the attachment point, after the port or its module was moved
+	 * or resized other than through move_connections() or module_moved(). */
+	void invalidate_connection_point() { _point_valid = false; }
+
 	boost::weak_ptr<Module> _module;
+	PortId                  _id;
 	std::string             _name;
 	Gnome::Canvas::Text*    _label;
 	Gnome::Canvas::Rect*    _rect;
@@ -159,14 +178,20 @@ protected:
 
 	Control* _control;
 	
-	double   _width;
-	double   _height;
-	double   _border_width;
-	uint32_t _color;
+	double      _width;
+	double      _height;
+	double      _border_width;
+	uint32_t    _color;
+	DetailLevel _detail;
+
+	Gnome::Art::Point _connection_point; ///< World coordinates of attachment point
 	
-	bool _is_input :1;
-	bool _selected :1;
-	bool _toggled  :1;
+	bool _is_input      :1;
+	bool _selected      :1;
+	bool _toggled       :1;
+	bool _point_valid   :1; ///< _connection_point and _horizontal are current
+	bool _horizontal    :1; ///< Canvas direction when _connection_point was found
+	bool _detail_hidden :1; ///< Hidden by set_detail(), not by its owner
 };
 
 typedef std::vector<boost::shared_ptr<Port> > PortVector;
@@ -0,0 +1,199 @@
+/* This file is part of FlowCanvas.
+ * Copyright (C) 2007-2009 David Robillard <http://drobilla.net>
+ *
+ * FlowCanvas is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * FlowCanvas is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#ifndef FLOWCANVAS_SLOTMAP_HPP
+#define FLOWCANVAS_SLOTMAP_HPP
+
+#include <cassert>
+#include <vector>
+
+#include <stdint.h>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/utility.hpp>
+
+namespace FlowCanvas {
+
+
+/** A compact identifier for an object of type T on a Canvas.
+ *
+ * Ids are 32 bits: a 20 bit slot number and a 12 bit generation of that
+ * slot.  An id is never reused for a different object, so it is safe to
+ * keep the id of an object that may be removed: looking it up will simply
+ * fail.  The default id (0) is null and never refers to an object.
+ *
+ * \ingroup FlowCanvas
+ */
+template <typename T>
+class SlotId {
+public:
+	static const uint32_t INDEX_BITS = 20;
+	static const uint32_t INDEX_MASK = (1u << INDEX_BITS) - 1;
+
+	SlotId() : _value(0) {}
+	explicit SlotId(uint32_t value) : _value(value) {}
+
+	uint32_t value() const   { return _value; }
+	bool     is_null() const { return _value == 0; }
+
+	/** Index of this id's slot (0 for the null id).
+	 * No two live objects share an index, so it may be used as an array index. */
+	uint32_t index() const { return _value & INDEX_MASK; }
+
+	inline bool operator==(const SlotId& id) const { return _value == id._value; }
+	inline bool operator!=(const SlotId& id) const { return _value != id._value; }
+	inline bool operator<(const SlotId& id) const  { return _value < id._value; }
+
+private:
+	uint32_t _value;
+};
+
+
+/** Storage for values of type V, with stable generation-checked ids.
+ *
+ * Values are kept contiguous (removal moves the last value into the hole),
+ * so iteration is fast but in no particular order.  Each id encodes a slot
+ * number and the generation of that slot, which is bumped on removal so
+ * stale ids never match a newer value.  Free slots are reused oldest first,
+ * so churn is spread over every free slot, and a slot whose 4096 generations
+ * are used up is retired rather than wrapping around.  A map can therefore
+ * hand out about 2^32 ids in its lifetime.
+ */
+template <typename T, typename V = boost::shared_ptr<T> >
+class SlotMap : boost::noncopyable {
+public:
+	typedef SlotId<T>                         Id;
+	typedef std::vector<V>                    Values;
+	typedef typename Values::iterator         iterator;
+	typedef typename Values::const_iterator   const_iterator;
+
+	SlotMap() : _free_head(NONE), _free_tail(NONE) {}
+
+	/** Add @a value and return its id. */
+	Id insert(const V& value) {
+		uint32_t s = _free_head;
+		if (s == NONE) {
+			assert(_slots.size() < INDEX_MASK);
+			s = _slots.size();
+			_slots.push_back(Slot());
+		} else {
+			_free_head = _slots[s].index;
+			if (_free_head == NONE)
+				_free_tail = NONE;
+		}
+
+		_slots[s].index = _values.size();
+		_values.push_back(value);
+		_owners.push_back(s);
+
+		return Id((_slots[s].generation << INDEX_BITS) | (s + 1));
+	}
+
+	/** Remove the value for @a id, if it is still present. */
+	void erase(Id id) {
+		const uint32_t s = slot(id);
+		if (s == NONE)
+			return;
+
+		// Move the last value into the hole
+		const uint32_t i = _slots[s].index;
+		_values[i] = _values.back();
+		_owners[i] = _owners.back();
+		_slots[_owners[i]].index = i;
+		_values.pop_back();
+		_owners.pop_back();
+
+		release(s);
+	}
+
+	/** Return the value for @a id, or V() if it has been removed. */
+	V get(Id id) const {
+		const uint32_t s = slot(id);
+		return (s != NONE) ? _values[_slots[s].index] : V();
+	}
+
+	bool contains(Id id) const { return slot(id) != NONE; }
+
+	/** Remove everything.  All current ids become stale. */
+	void clear() {
+		for (typename std::vector<uint32_t>::const_iterator o = _owners.begin(); o != _owners.end(); ++o)
+			release(*o);
+		_values.clear();
+		_owners.clear();
+	}
+
+	size_t size() const { return _values.size(); }
+	bool   empty() const { return _values.empty(); }
+
+	iterator       begin()       { return _values.begin(); }
+	iterator       end()         { return _values.end(); }
+	const_iterator begin() const { return _values.begin(); }
+	const_iterator end()   const { return _values.end(); }
+
+private:
+	static const uint32_t INDEX_BITS     = Id::INDEX_BITS;
+	static const uint32_t INDEX_MASK     = Id::INDEX_MASK;
+	static const uint32_t GENERATION_MAX = (1u << (32 - INDEX_BITS)) - 1;
+	static const uint32_t NONE           = 0xFFFFFFFF;
+
+	struct Slot {
+		Slot() : generation(0), index(NONE) {}
+		uint32_t generation;
+		uint32_t index; ///< Index in _values if used, next free slot if free
+	};
+
+	/** Return the slot number @a id refers to, or NONE if it is stale. */
+	uint32_t slot(Id id) const {
+		const uint32_t s = id.index();
+		if (s == 0 || s > _slots.size())
+			return NONE;
+
+		const Slot& slot = _slots[s - 1];
+		if (slot.generation != (id.value() >> INDEX_BITS)
+				|| slot.index >= _owners.size() || _owners[slot.index] != s - 1)
+			return NONE;
+
+		return s - 1;
+	}
+
+	/** Put slot @a s at the end of the free list, or retire it if its
+	 * generations are used up. */
+	void release(uint32_t s) {
+		Slot& slot = _slots[s];
+		slot.index = NONE;
+		if (slot.generation == GENERATION_MAX)
+			return; // Retired, any id could match it
+
+		++slot.generation;
+		if (_free_tail == NONE)
+			_free_head = s;
+		else
+			_slots[_free_tail].index = s;
+		_free_tail = s;
+	}
+
+	std::vector<Slot>     _slots;
+	Values                _values;
+	std::vector<uint32_t> _owners;    ///< Slot number of each value
+	uint32_t              _free_head; ///< Oldest free slot, or NONE
+	uint32_t              _free_tail; ///< Newest free slot, or NONE
+};
+
+
+} // namespace FlowCanvas
+
+#endif // FLOWCANVAS_SLOTMAP_HPP
@@ -0,0 +1,148 @@
+/* This file is part of FlowCanvas.
+ * Copyright (C) 2007-2009 David Robillard <http://drobilla.net>
+ *
+ * FlowCanvas is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * FlowCanvas is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#include <cassert>
+
+#include "ArrangeJob.hpp"
+
+namespace FlowCanvas {
+
+
+ArrangeJob::ArrangeJob(LayoutEngine e, bool c, DotSession* s)
+	: engine(e)
+	, center(c)
+	, succeeded(false)
+	, session(s)
+	, _pending(0)
+	, _owned_session(NULL)
+	, _finished(false)
+	, _released(false)
+	, _handling(false)
+{
+	_progress_dispatcher.connect(sigc::mem_fun(this, &ArrangeJob::on_progress));
+	_done_dispatcher.connect(sigc::mem_fun(this, &ArrangeJob::on_done));
+}
+
+
+ArrangeJob::~ArrangeJob()
+{
+	delete _owned_session;
+}
+
+
+bool
+ArrangeJob::start()
+{
+	if (!Glib::thread_supported())
+		return false;
+
+	Glib::Thread::create(sigc::mem_fun(this, &ArrangeJob::run), false);
+	return true;
+}
+
+
+void
+ArrangeJob::run()
+{
+	succeeded = layout(graph, engine, this, session);
+
+	// Nothing may touch the job after this, it may be deleted at any time
+	send(_done_dispatcher);
+}
+
+
+/** Emit @a dispatcher (in any thread), counting it until it is received. */
+void
+ArrangeJob::send(Glib::Dispatcher& dispatcher)
+{
+	{
+		Glib::Mutex::Lock lock(_send_mutex);
+		++_pending;
+	}
+	dispatcher.emit();
+}
+
+
+void
+ArrangeJob::received()
+{
+	Glib::Mutex::Lock lock(_send_mutex);
+	assert(_pending > 0);
+	--_pending;
+}
+
+
+void
+ArrangeJob::on_progress()
+{
+	received();
+
+	_handling = true;
+	signal_progress.emit();
+	_handling = false;
+
+	collect();
+}
+
+
+void
+ArrangeJob::on_done()
+{
+	received();
+	_finished = true;
+
+	_handling = true;
+	signal_done.emit();
+	_handling = false;
+
+	collect();
+}
+
+
+void
+ArrangeJob::release(DotSession* owned_session)
+{
+	assert(!_released);
+
+	signal_progress.clear();
+	signal_done.clear();
+	_owned_session = owned_session;
+	_released      = true;
+
+	if (!_handling)
+		collect();
+}
+
+
+/** Delete the job if it is released, finished, and nothing is on its way. */
+void
+ArrangeJob::collect()
+{
+	if (!_released || !_finished)
+		return;
+
+	{
+		Glib::Mutex::Lock lock(_send_mutex);
+		if (_pending > 0)
+			return;
+	}
+
+	delete this;
+}
+
+
+} // namespace FlowCanvas
@@ -0,0 +1,89 @@
+/* This file is part of FlowCanvas.
+ * Copyright (C) 2007-2009 David Robillard <http://drobilla.net>
+ *
+ * FlowCanvas is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * FlowCanvas is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#ifndef FLOWCANVAS_ARRANGEJOB_HPP
+#define FLOWCANVAS_ARRANGEJOB_HPP
+
+#include <boost/utility.hpp>
+
+#include <glibmm/dispatcher.h>
+#include <glibmm/thread.h>
+
+#include "Layout.hpp"
+
+namespace FlowCanvas {
+
+
+/** A layout of a LayoutGraph running in a worker thread.
+ *
+ * The job is created and started in the GUI thread, and its signals are
+ * emitted in the GUI thread's main loop, so handlers may safely touch the
+ * canvas.  A layout can not be interrupted, so a job is never waited for:
+ * once it is not needed (or has been handled), it is released, and deletes
+ * itself in the GUI thread when the worker has finished and everything the
+ * worker sent has been received.
+ */
+class ArrangeJob : public LayoutProgress, boost::noncopyable {
+public:
+	ArrangeJob(LayoutEngine e, bool c, DotSession* s);
+
+	/** Start laying out graph in a new thread.
+	 * Returns false if threads are unavailable (and nothing was started). */
+	bool start();
+
+	/** Lay out graph in this thread (if start() failed).
+	 * signal_done is still emitted from the main loop. */
+	void run();
+
+	/** Disconnect the signals, and delete the job once it is finished.
+	 * If @a owned_session is given it is deleted along with the job.
+	 * The job must not be used after this. */
+	void release(DotSession* owned_session=NULL);
+
+	LayoutGraph  graph;     ///< Input, and output if succeeded
+	LayoutEngine engine;    ///< Layout to use
+	bool         center;    ///< Center the result on the canvas
+	bool         succeeded; ///< Layout finished and was not cancelled
+	DotSession*  session;   ///< Graphviz state to lay out with, or NULL
+
+	sigc::signal<void> signal_progress; ///< Progress has changed
+	sigc::signal<void> signal_done;     ///< Layout has finished or been cancelled
+
+private:
+	~ArrangeJob();
+
+	void progress_changed() { send(_progress_dispatcher); }
+	void send(Glib::Dispatcher& dispatcher);
+	void on_progress();
+	void on_done();
+	void received();
+	void collect();
+
+	Glib::Mutex      _send_mutex;
+	unsigned         _pending;       ///< Sent but not yet received (guarded)
+	DotSession*      _owned_session; ///< Deleted with the job
+	bool             _finished;      ///< signal_done has been received
+	bool             _released;
+	bool             _handling;      ///< In a signal handler
+	Glib::Dispatcher _progress_dispatcher;
+	Glib::Dispatcher _done_dispatcher;
+};
+
+
+} // namespace FlowCanvas
+
+#endif // FLOWCANVAS_ARRANGEJOB_HPP
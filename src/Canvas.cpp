@@ -26,15 +26,16 @@
 #include <vector>
 
 #include <boost/enable_shared_from_this.hpp>
+#include <boost/pool/pool_alloc.hpp>
 
 #include "flowcanvas-config.h"
 #include "flowcanvas/Canvas.hpp"
 #include "flowcanvas/Module.hpp"
 #include "flowcanvas/Port.hpp"
-
-#ifdef HAVE_AGRAPH
-#include <gvc.h>
-#endif
+#include "ArrangeJob.hpp"
+#include "ForceLayout.hpp"
+#include "Layout.hpp"
+#include "SpatialIndex.hpp"
 
 using std::cerr;
 using std::endl;
@@ -47,17 +48,41 @@ namespace FlowCanvas {
 sigc::signal<void, Gnome::Canvas::Item*> Canvas::signal_item_entered;
 sigc::signal<void, Gnome::Canvas::Item*> Canvas::signal_item_left;
 
+
 Canvas::Canvas(double width, double height)
-	: _base_rect(*root(), 0, 0, width, height)
+	: _arrange_job(NULL)
+	, _force_layout(NULL)
+	, _dot_session(new DotSession())
+	, _connection_pool_size(0)
+	, _port_select_count(0)
+	, _item_index(new SpatialIndex<Item>(Box(0.0, 0.0, width, height)))
+	, _connection_bounds(new SpatialIndex<Connection>(Box(0.0, 0.0, width, height)))
+	, _view_x1(0.0)
+	, _view_y1(0.0)
+	, _view_x2(0.0)
+	, _view_y2(0.0)
+	, _update_depth(0)
+	, _base_rect(*root(), 0, 0, width, height)
 	, _select_rect(NULL)
+	, _select_frame(NULL)
 	, _select_dash(NULL)
 	, _zoom(1.0)
+	, _reduced_detail_zoom(0.4)
+	, _minimal_detail_zoom(0.2)
+	, _detail(DETAIL_FULL)
 	, _width(width)
 	, _height(height)
 	, _drag_state(NOT_DRAGGING)
 	, _direction(HORIZONTAL)
+	, _layout_engine(LAYOUT_DOT)
 	, _remove_objects(true)
 	, _locked(false)
+	, _live_select(false)
+	, _resize_pending(false)
+	, _select_frame_dirty(false)
+	, _incremental_placement(false)
+	, _resizing_items(false)
+	, _culling(false)
 {
 	set_scroll_region(0.0, 0.0, width, height);
 	set_center_scroll_region(true);
@@ -78,16 +103,28 @@ Canvas::Canvas(double width, double height)
 	_select_dash->dash[0] = 5;
 	_select_dash->dash[1] = 5;
 
-	Glib::signal_timeout().connect(
-		sigc::mem_fun(this, &Canvas::animate_selected), 300);
+	// Only animate while there is a visible selection
+	signal_map().connect(sigc::mem_fun(this, &Canvas::update_select_animation));
+	signal_unmap().connect(sigc::mem_fun(this, &Canvas::update_select_animation));
+
+	signal_size_allocate().connect(sigc::mem_fun(this, &Canvas::on_size_allocated));
 }
 
 
 Canvas::~Canvas()
 {
+	abandon_arrange();
+	delete _dot_session;
+	_force_timeout.disconnect();
+	delete _force_layout;
 	destroy();
+	set_connection_pool_size(0);
+	_animate_timeout.disconnect();
+	delete _select_frame;
 	art_free(_select_dash->dash);
 	delete _select_dash;
+	delete _item_index;
+	delete _connection_bounds;
 }
 
 
@@ -111,12 +148,84 @@ Canvas::set_zoom(double pix_per_unit)
 
 	_zoom = pix_per_unit;
 	set_pixels_per_unit(_zoom);
+	queue_cull();
+
+	// Text is hidden below full detail, so is only scaled when shown again
+	if (apply_detail() == DETAIL_FULL) {
+		for (SlotMap<Item>::iterator m = _item_slots.begin(); m != _item_slots.end(); ++m)
+			(*m)->zoom(_zoom);
+
+		for (SlotMap<Connection>::iterator c = _connection_slots.begin(); c != _connection_slots.end(); ++c)
+			(*c)->zoom(_zoom);
+	}
+}
+
+
+/** Set the zoom levels below which less of the canvas is drawn.
+ *
+ * Below @a reduced, text and control gauges are hidden.  Below @a minimal,
+ * modules are drawn as plain boxes and connections as straight lines.
+ * Pass 0 for both to always draw everything.
+ */
+void
+Canvas::set_detail_thresholds(double reduced, double minimal)
+{
+	_reduced_detail_zoom = reduced;
+	_minimal_detail_zoom = minimal;
+
+	const DetailLevel old_detail = _detail;
+	if (apply_detail() == DETAIL_FULL && old_detail != DETAIL_FULL) {
+		const double zoom = _zoom;
+		_zoom = 0.0; // force set_zoom to rescale the text being shown again
+		set_zoom(zoom);
+	}
+}
+
 
-	for (ItemList::iterator m = _items.begin(); m != _items.end(); ++m)
-		(*m)->zoom(_zoom);
+/** Update the detail level for the current zoom, and apply it if changed.
+ * Returns the new level.
+ */
+DetailLevel
+Canvas::apply_detail()
+{
+	DetailLevel detail = DETAIL_FULL;
+	if (_zoom < _minimal_detail_zoom)
+		detail = DETAIL_MINIMAL;
+	else if (_zoom < _reduced_detail_zoom)
+		detail = DETAIL_REDUCED;
+
+	if (detail == _detail)
+		return _detail;
+
+	_detail = detail;
+
+	ScopedUpdate update(*this);
+	for (SlotMap<Item>::iterator m = _item_slots.begin(); m != _item_slots.end(); ++m)
+		(*m)->set_detail(_detail);
+
+	for (SlotMap<Connection>::iterator c = _connection_slots.begin(); c != _connection_slots.end(); ++c)
+		(*c)->set_detail(_detail);
+
+	return _detail;
+}
 
-	for (list<boost::shared_ptr<Connection> >::iterator c = _connections.begin(); c != _connections.end(); ++c)
-		(*c)->zoom(_zoom);
+
+/** Set the direction of flow, which determines where connections attach. */
+void
+Canvas::set_direction(FlowDirection d)
+{
+	if (d == _direction)
+		return;
+
+	_direction = d;
+
+	ScopedUpdate update(*this);
+	for (ItemList::iterator i = _items.begin(); i != _items.end(); ++i) {
+		boost::shared_ptr<Module> module = boost::dynamic_pointer_cast<Module>(*i);
+		if (module)
+			for (PortVector::iterator p = module->ports().begin(); p != module->ports().end(); ++p)
+				(*p)->move_connections();
+	}
 }
 
 
@@ -151,10 +260,8 @@ Canvas::zoom_full()
 	double top    = DBL_MIN;
 	double bottom = DBL_MAX;
 
-	for (ItemList::iterator m = _items.begin(); m != _items.end(); ++m) {
+	for (SlotMap<Item>::const_iterator m = _item_slots.begin(); m != _item_slots.end(); ++m) {
 		const boost::shared_ptr<Item> mod = (*m);
-		if (!mod)
-			continue;
 
 		if (mod->property_x() < left)
 			left = mod->property_x();
@@ -186,26 +293,37 @@ Canvas::clear_selection()
 {
 	unselect_ports();
 
-	for (list<boost::shared_ptr<Item> >::iterator m = _selected_items.begin(); m != _selected_items.end(); ++m)
+	for (ItemSet::iterator m = _selected_items.begin(); m != _selected_items.end(); ++m)
 		(*m)->set_selected(false);
 
-	for (list<boost::shared_ptr<Connection> >::iterator c = _selected_connections.begin(); c != _selected_connections.end(); ++c)
+	for (ConnectionSet::iterator c = _selected_connections.begin(); c != _selected_connections.end(); ++c)
 		(*c)->set_selected(false);
 
 	_selected_items.clear();
 	_selected_connections.clear();
+	selection_changed();
 }
 
 
+/** Equality between a raw pointer and a shared_ptr set element. */
+template <typename T>
+struct SharedPtrEqual {
+	bool operator()(const T* a, const boost::shared_ptr<T>& b) const
+		{ return a == b.get(); }
+	bool operator()(const boost::shared_ptr<T>& a, const T* b) const
+		{ return a.get() == b; }
+};
+
+
 void
 Canvas::unselect_connection(Connection* connection)
 {
-	for (ConnectionList::iterator i = _selected_connections.begin(); i != _selected_connections.end();) {
-		if ((*i).get() == connection) {
-			i = _selected_connections.erase(i);
-		} else {
-			++i;
-		}
+	ConnectionSet::iterator i = _selected_connections.find(
+		connection, boost::hash<const Connection*>(), SharedPtrEqual<Connection>());
+
+	if (i != _selected_connections.end()) {
+		_selected_connections.erase(i);
+		selection_changed();
 	}
 
 	connection->set_selected(false);
@@ -219,40 +337,25 @@ Canvas::select_item(boost::shared_ptr<Item> m)
 {
 	assert(! m->selected());
 
-	_selected_items.push_back(m);
-
-	for (ConnectionList::iterator i = _connections.begin(); i != _connections.end(); ++i) {
-		const boost::shared_ptr<Connection>  c = (*i);
-		const boost::shared_ptr<Connectable> src = c->source().lock();
-		const boost::shared_ptr<Connectable> dst = c->dest().lock();
-		if (!src || !dst)
-			continue;
-
-		const boost::shared_ptr<Port> src_port
-			= boost::dynamic_pointer_cast<Port>(src);
-		const boost::shared_ptr<Port> dst_port
-			= boost::dynamic_pointer_cast<Port>(dst);
-
-		if (!src_port || !dst_port)
-			continue;
+	_selected_items.insert(m);
 
-		const boost::shared_ptr<Module> src_module = src_port->module().lock();
-		const boost::shared_ptr<Module> dst_module = dst_port->module().lock();
-		if (!src_module || !dst_module)
+	const ConnectionSet& connections = item_connections(m);
+	for (ConnectionSet::const_iterator i = connections.begin(); i != connections.end(); ++i) {
+		const boost::shared_ptr<Connection> c = (*i);
+		if (c->selected())
 			continue;
 
-		if ( !c->selected()) {
-			if (src_module == m && dst_module->selected()) {
-				c->set_selected(true);
-				_selected_connections.push_back(c);
-			} else if (dst_module == m && src_module->selected()) {
-				c->set_selected(true);
-				_selected_connections.push_back(c);
-			}
+		// Selected items are kept alive by _selected_items, so no need to lock
+		const Item* const other = (c->_source_item == m.get()) ? c->_dest_item : c->_source_item;
+		if (_selected_items.find(other, boost::hash<const Item*>(), SharedPtrEqual<Item>())
+				!= _selected_items.end()) {
+			c->set_selected(true);
+			_selected_connections.insert(c);
 		}
 	}
 
 	m->set_selected(true);
+	selection_changed();
 }
 
 
@@ -260,43 +363,20 @@ void
 Canvas::unselect_item(boost::shared_ptr<Item> m)
 {
 	// Remove any connections that aren't selected anymore because this module isn't
-	boost::shared_ptr<Connection> c;
-	for (ConnectionList::iterator i = _selected_connections.begin(); i != _selected_connections.end() ; ) {
-		c = (*i);
-
-		if (boost::dynamic_pointer_cast<Item>(c->source().lock()) == m
-				|| boost::dynamic_pointer_cast<Item>(c->dest().lock()) == m) {
-			c->set_selected(false);
-			i = _selected_connections.erase(i);
-			continue;
-		}
-
-		boost::shared_ptr<Port> src_port = boost::dynamic_pointer_cast<Port>(c->source().lock());
-		if (src_port && src_port->module().lock() == m) {
-			c->set_selected(false);
-			i = _selected_connections.erase(i);
-			continue;
-		}
-
-		boost::shared_ptr<Port> dst_port = boost::dynamic_pointer_cast<Port>(c->dest().lock());
-		if (dst_port && dst_port->module().lock() == m) {
+	const ConnectionSet& connections = item_connections(m);
+	for (ConnectionSet::const_iterator i = connections.begin(); i != connections.end(); ++i) {
+		const boost::shared_ptr<Connection> c = (*i);
+		if (c->selected()) {
 			c->set_selected(false);
-			i = _selected_connections.erase(i);
-			continue;
+			_selected_connections.erase(c);
 		}
-
-		++i;
 	}
 
 	// Remove the module
-	for (list<boost::shared_ptr<Item> >::iterator i = _selected_items.begin(); i != _selected_items.end(); ++i) {
-		if ((*i) == m) {
-			_selected_items.erase(i);
-			break;
-		}
-	}
+	_selected_items.erase(m);
 
 	m->set_selected(false);
+	selection_changed();
 }
 
 
@@ -307,14 +387,38 @@ Canvas::destroy()
 {
 	_remove_objects = false;
 
+	_new_modules.clear();
+	_unplaced_modules.clear();
 	_selected_items.clear();
 	_selected_connections.clear();
+	selection_changed();
+
+	for (SlotMap<Connection>::iterator c = _connection_slots.begin(); c != _connection_slots.end(); ++c)
+		(*c)->_id = ConnectionId();
 
 	_connections.clear();
+	_connection_slots.clear();
+	_connection_index.clear();
+	_adjacency.clear();
 
 	_selected_ports.clear();
 	_connect_port.reset();
 
+	_item_index->clear();
+	_connection_bounds->clear();
+	_shown_items.clear();
+	_shown_connections.clear();
+	_cull_idle.disconnect();
+	_select_preview.clear();
+	_dirty_modules.clear();
+	_dirty_connections.clear();
+	_update_connections_idle.disconnect();
+
+	for (SlotMap<Item>::iterator i = _item_slots.begin(); i != _item_slots.end(); ++i)
+		(*i)->_id = ItemId();
+
+	_port_slots.clear();
+	_item_slots.clear();
 	_items.clear();
 
 	_remove_objects = true;
@@ -325,7 +429,7 @@ void
 Canvas::unselect_ports()
 {
 	for (SelectedPorts::iterator i = _selected_ports.begin(); i != _selected_ports.end(); ++i)
-		(*i)->set_selected(false);
+		i->first->set_selected(false);
 
 	_selected_ports.clear();
 	_last_selected_port.reset();
@@ -338,9 +442,7 @@ Canvas::select_port(boost::shared_ptr<Port> p, bool unique)
 	if (unique)
 		unselect_ports();
 	p->set_selected(true);
-	SelectedPorts::iterator i = find(_selected_ports.begin(), _selected_ports.end(), p);
-	if (i == _selected_ports.end())
-		_selected_ports.push_back(p);
+	_selected_ports.insert(std::make_pair(p, _port_select_count++));
 	_last_selected_port = p;
 }
 
@@ -348,9 +450,7 @@ Canvas::select_port(boost::shared_ptr<Port> p, bool unique)
 void
 Canvas::unselect_port(boost::shared_ptr<Port> p)
 {
-	SelectedPorts::iterator i = find(_selected_ports.begin(), _selected_ports.end(), p);
-	if (i != _selected_ports.end())
-		_selected_ports.erase(i);
+	_selected_ports.erase(p);
 	p->set_selected(false);
 	if (_last_selected_port == p)
 		_last_selected_port.reset();
@@ -401,26 +501,268 @@ Canvas::select_port_toggle(boost::shared_ptr<Port> p, int mod_state)
 }
 
 
-/** Sets the passed module's location to a reasonable default.
+/** Give a new module an initial position.
+ *
+ * Modules are cascaded from the centre of the canvas.  With incremental
+ * placement, the module is moved again once control returns to the main
+ * loop (so its connections have been made), to free space next to the
+ * modules it is connected to.  Nothing else on the canvas is moved.
  */
 void
 Canvas::set_default_placement(boost::shared_ptr<Module> m)
 {
 	assert(m);
 
-	// Simple cascade.  This will get more clever in the future.
-	double x = ((_width / 2.0) + (_items.size() * 25));
-	double y = ((_height / 2.0) + (_items.size() * 25));
+	// Simple cascade
+	double x = ((_width / 2.0) + (_item_slots.size() * 25));
+	double y = ((_height / 2.0) + (_item_slots.size() * 25));
 
 	m->move_to(x, y);
+
+	if (_incremental_placement) {
+		_new_modules.push_back(m);
+		if (!_place_idle.connected())
+			_place_idle = Glib::signal_idle().connect(
+				sigc::mem_fun(this, &Canvas::place_new_modules),
+				Glib::PRIORITY_HIGH_IDLE);
+	}
+}
+
+
+/** Place modules passed to set_default_placement() since the last call.
+ *
+ * Modules connected to already placed ones are placed first, and placing a
+ * module makes its new neighbours placeable in turn, so new chains grow
+ * outwards from the existing graph.  Modules with no placed neighbours are
+ * placed in free space near where they were cascaded.
+ */
+bool
+Canvas::place_new_modules()
+{
+	std::vector<boost::shared_ptr<Module> > pending;
+	for (NewModules::const_iterator i = _new_modules.begin(); i != _new_modules.end(); ++i) {
+		boost::shared_ptr<Module> m = i->lock();
+		if (m && _item_slots.get(m->id()) == m && _unplaced_modules.insert(m.get()).second)
+			pending.push_back(m);
+	}
+	_new_modules.clear();
+
+	ScopedUpdate update(*this);
+
+	std::vector<boost::shared_ptr<Module> > queue;
+	for (std::vector<boost::shared_ptr<Module> >::const_iterator i = pending.begin();
+			i != pending.end(); ++i) {
+		double x, y;
+		if (placement_near_neighbours(*i, x, y))
+			queue.push_back(*i);
+	}
+
+	size_t next_pending = 0;
+	for (size_t head = 0; !_unplaced_modules.empty();) {
+		boost::shared_ptr<Module> m;
+		double x = 0.0, y = 0.0;
+		if (head < queue.size()) {
+			m = queue[head++];
+			if (!_unplaced_modules.count(m.get()))
+				continue;
+			placement_near_neighbours(m, x, y);
+		} else {
+			// Nothing left next to a placed module, start a new group
+			while (!_unplaced_modules.count(pending[next_pending].get()))
+				++next_pending;
+			m = pending[next_pending];
+			x = m->property_x() + m->width() / 2.0;
+			y = m->property_y() + m->height() / 2.0;
+		}
+
+		place_module(m, x, y);
+		_unplaced_modules.erase(m.get());
+
+		// Neighbours waiting to be placed can now go next to this module
+		const ConnectionSet& connections = item_connections(m);
+		for (ConnectionSet::const_iterator c = connections.begin(); c != connections.end(); ++c) {
+			const Item* const other = ((*c)->_source_item == m.get())
+				? (*c)->_dest_item : (*c)->_source_item;
+			if (other && _unplaced_modules.count(other))
+				queue.push_back(boost::dynamic_pointer_cast<Module>(
+					const_cast<Item*>(other)->shared_from_this()));
+		}
+	}
+
+	return false;
+}
+
+
+/** Find where @a m would like to be, next to its placed neighbours.
+ *
+ * Upstream neighbours want @a m after them in the direction of flow, and
+ * downstream ones before.  Returns false if @a m has no placed neighbours.
+ */
+bool
+Canvas::placement_near_neighbours(boost::shared_ptr<Module> m, double& x, double& y) const
+{
+	static const double gap = 64.0;
+
+	double   sum_x = 0.0;
+	double   sum_y = 0.0;
+	unsigned count = 0;
+
+	const ConnectionSet& connections = item_connections(m);
+	for (ConnectionSet::const_iterator i = connections.begin(); i != connections.end(); ++i) {
+		const Connection* const c = i->get();
+		const bool   upstream = (c->_dest_item == m.get());
+		const Item*  other    = upstream ? c->_source_item : c->_dest_item;
+		if (!other || other == m.get() || _unplaced_modules.count(other))
+			continue;
+
+		Item* const  o  = const_cast<Item*>(other);
+		const double ox = o->property_x() + o->width() / 2.0;
+		const double oy = o->property_y() + o->height() / 2.0;
+		if (_direction == HORIZONTAL) {
+			const double d = (o->width() + m->width()) / 2.0 + gap;
+			sum_x += upstream ? ox + d : ox - d;
+			sum_y += oy;
+		} else {
+			const double d = (o->height() + m->height()) / 2.0 + gap;
+			sum_x += ox;
+			sum_y += upstream ? oy + d : oy - d;
+		}
+		++count;
+	}
+
+	if (count == 0)
+		return false;
+
+	x = sum_x / count;
+	y = sum_y / count;
+	return true;
+}
+
+
+/** Move @a m to the free space nearest to centre (@a x, @a y).
+ *
+ * Space is searched for on growing rings around the desired position,
+ * looking up each candidate in the item index, so the cost does not depend
+ * on how much is on the canvas.  Moving across the direction of flow is
+ * preferred, so modules fed by the same module stack up beside each other.
+ */
+void
+Canvas::place_module(boost::shared_ptr<Module> m, double x, double y)
+{
+	static const double   pad       = 8.0;
+	static const unsigned max_rings = 16;
+
+	const double w      = m->width();
+	const double h      = m->height();
+	const double step_x = (_direction == HORIZONTAL) ? w / 2.0 : w + pad * 2.0;
+	const double step_y = (_direction == HORIZONTAL) ? h + pad * 2.0 : h / 2.0;
+
+	// Cost of moving a step along the direction of flow, relative to across
+	const double along = 2.0;
+
+	vector<Item*> hits;
+	for (unsigned ring = 0; ring <= max_rings; ++ring) {
+		bool   found     = false;
+		double best_cost = HUGE_VAL;
+		double best_x    = x;
+		double best_y    = y;
+
+		const int r = ring;
+		for (int i = -r; i <= r; ++i) {
+			for (int j = -r; j <= r; ++j) {
+				if (std::max(abs(i), abs(j)) != r)
+					continue; // inside, already tried
+
+				const double cx = x + i * step_x;
+				const double cy = y + j * step_y;
+				const double x1 = cx - w / 2.0;
+				const double y1 = cy - h / 2.0;
+				if (x1 < 0.0 || y1 < 0.0 || x1 + w > _width || y1 + h > _height)
+					continue;
+
+				hits.clear();
+				_item_index->find(Box(x1 - pad, y1 - pad, x1 + w + pad, y1 + h + pad), hits);
+				if (!(hits.empty() || (hits.size() == 1 && hits[0] == m.get())))
+					continue;
+
+				const double cost = (_direction == HORIZONTAL)
+					? along * abs(i) + abs(j)
+					: abs(i) + along * abs(j);
+				if (cost < best_cost) {
+					found     = true;
+					best_cost = cost;
+					best_x    = cx;
+					best_y    = cy;
+				}
+			}
+		}
+
+		if (found) {
+			x = best_x;
+			y = best_y;
+			break;
+		}
+	}
+
+	m->move_to(x - w / 2.0, y - h / 2.0);
 }
 
 
 void
 Canvas::add_item(boost::shared_ptr<Item> m)
 {
-	if (m)
+	if (m) {
 		_items.push_back(m);
+		m->_id = _item_slots.insert(m);
+		if (_detail != DETAIL_FULL)
+			m->set_detail(_detail);
+		double x1, y1, x2, y2;
+		m->world_bounds(x1, y1, x2, y2);
+		_item_index->insert(m.get(), Box(x1, y1, x2, y2));
+		if (_culling) {
+			_shown_items.insert(m.get());
+			set_shown(m.get(), in_view(x1, y1, x2, y2));
+		}
+	}
+}
+
+
+/** Update the location of @a item for hit testing.
+ *
+ * Items call this whenever they move or change size.
+ */
+void
+Canvas::item_bounds_changed(Item* item)
+{
+	double x1, y1, x2, y2;
+	item->world_bounds(x1, y1, x2, y2);
+	_item_index->update(item, Box(x1, y1, x2, y2));
+	if (_culling && _item_index->contains(item))
+		set_shown(item, in_view(x1, y1, x2, y2));
+	if (item->selected())
+		_select_frame_dirty = true;
+}
+
+
+/** Update the location of @a c for culling.
+ *
+ * Connections call this whenever they are routed.
+ */
+void
+Canvas::connection_bounds_changed(Connection* c, double x1, double y1, double x2, double y2)
+{
+	if (!_connection_slots.contains(c->_id))
+		return; // not (or no longer) on this canvas
+
+	if (_connection_bounds->contains(c))
+		_connection_bounds->update(c, Box(x1, y1, x2, y2));
+	else
+		_connection_bounds->insert(c, Box(x1, y1, x2, y2));
+
+	if (_culling)
+		set_shown(c, in_view(x1, y1, x2, y2));
+	if (c->selected())
+		_select_frame_dirty = true;
 }
 
 
@@ -433,12 +775,8 @@ Canvas::remove_item(boost::shared_ptr<Item> item)
 	bool ret = false;
 
 	// Remove from selection
-	for (list<boost::shared_ptr<Item> >::iterator i = _selected_items.begin(); i != _selected_items.end(); ++i) {
-		if ((*i) == item) {
-			_selected_items.erase(i);
-			break;
-		}
-	}
+	if (_selected_items.erase(item))
+		selection_changed();
 
 	// Remove children ports from selection if item is a module
 	boost::shared_ptr<Module> module = boost::dynamic_pointer_cast<Module>(item);
@@ -446,8 +784,15 @@ Canvas::remove_item(boost::shared_ptr<Item> item)
 		for (PortVector::iterator i = module->ports().begin(); i != module->ports().end(); ++i) {
 			unselect_port(*i);
 		}
+		forget_updates(module.get());
 	}
 
+	_item_index->remove(item.get());
+	_shown_items.erase(item.get());
+	_select_preview.erase(item.get());
+	_item_slots.erase(item->_id);
+	item->_id = ItemId();
+
 	// Remove from items
 	for (ItemList::iterator i = _items.begin(); i != _items.end(); ++i) {
 		if (*i == item) {
@@ -458,24 +803,13 @@ Canvas::remove_item(boost::shared_ptr<Item> item)
 	}
 
 	// Remove any connections adjacent to this item
-	boost::shared_ptr<Connection> c;
-	for (ConnectionList::iterator i = _connections.begin(); i != _connections.end() ; ) {
-		c = (*i);
-		ConnectionList::iterator next = i;
-		++next;
-
-		const boost::shared_ptr<Port> src_port
-			= boost::dynamic_pointer_cast<Port>(c->source().lock());
-		const boost::shared_ptr<Port> dst_port
-			= boost::dynamic_pointer_cast<Port>(c->dest().lock());
-
-		if (boost::dynamic_pointer_cast<Item>(c->source().lock()) == item
-				|| boost::dynamic_pointer_cast<Item>(c->dest().lock()) == item
-				|| (src_port && src_port->module().lock() == item)
-				|| (dst_port && dst_port->module().lock() == item))
-			remove_connection(c);
-
-		i = next;
+	Adjacency::iterator a = _adjacency.find(item.get());
+	if (a != _adjacency.end()) {
+		const ConnectionSet adjacent = a->second; // copy, removal modifies
+		for (ConnectionSet::const_iterator i = adjacent.begin(); i != adjacent.end(); ++i)
+			remove_connection(*i);
+
+		_adjacency.erase(item.get());
 	}
 
 	return ret;
@@ -514,15 +848,7 @@ bool
 Canvas::are_connected(boost::shared_ptr<const Connectable> tail,
                       boost::shared_ptr<const Connectable> head)
 {
-	for (ConnectionList::const_iterator c = _connections.begin(); c != _connections.end(); ++c) {
-		const boost::shared_ptr<Connectable> src = (*c)->source().lock();
-		const boost::shared_ptr<Connectable> dst = (*c)->dest().lock();
-
-		if (src == tail && dst == head)
-			return true;
-	}
-
-	return false;
+	return find_connection(tail.get(), head.get()) != _connection_index.end();
 }
 
 
@@ -530,20 +856,133 @@ Canvas::are_connected(boost::shared_ptr<const Connectable> tail,
  *
  * Note that connections are directed.
  * This will only return a connection from @a tail to @a head.
+ * If there are several, any one of them is returned.
  */
 boost::shared_ptr<Connection>
 Canvas::get_connection(boost::shared_ptr<Connectable> tail,
                            boost::shared_ptr<Connectable> head) const
 {
-	for (ConnectionList::const_iterator i = _connections.begin(); i != _connections.end(); ++i) {
-		const boost::shared_ptr<Connectable> src = (*i)->source().lock();
-		const boost::shared_ptr<Connectable> dst = (*i)->dest().lock();
+	ConnectionIndex::const_iterator i = find_connection(tail.get(), head.get());
+	if (i != _connection_index.end())
+		return *i->second;
+
+	return boost::shared_ptr<Connection>();
+}
+
+
+/** Find an index entry for a connection from @a tail to @a head.
+ *
+ * Entries are keyed by address, so an entry is only returned if the
+ * connection it refers to still has @a tail and @a head as endpoints
+ * (an endpoint may have been destroyed and its address reused).
+ */
+Canvas::ConnectionIndex::const_iterator
+Canvas::find_connection(const Connectable* tail, const Connectable* head) const
+{
+	typedef std::pair<ConnectionIndex::const_iterator, ConnectionIndex::const_iterator> Range;
 
-		if (src == tail && dst == head)
-			return *i;
+	const Range r = _connection_index.equal_range(ConnectionKey(tail, head));
+	for (ConnectionIndex::const_iterator i = r.first; i != r.second; ++i) {
+		const boost::shared_ptr<Connection>& c = *i->second;
+		if (c->source().lock().get() == tail && c->dest().lock().get() == head)
+			return i;
 	}
 
-	return boost::shared_ptr<Connection>();
+	return _connection_index.end();
+}
+
+
+/** Add the connection at @a i in _connections to the endpoint index.
+ *
+ * Duplicate connections between the same endpoints each get an entry, so
+ * removing one leaves the others indexed.
+ */
+void
+Canvas::index_connection(ConnectionList::iterator i)
+{
+	const boost::shared_ptr<Connectable> src = (*i)->source().lock();
+	const boost::shared_ptr<Connectable> dst = (*i)->dest().lock();
+	assert(src && dst);
+
+	_connection_index.insert(std::make_pair(ConnectionKey(src.get(), dst.get()), i));
+}
+
+
+/** Find the index entry for @a connection, or end() if it is not indexed. */
+Canvas::ConnectionIndex::iterator
+Canvas::find_index_entry(boost::shared_ptr<Connection> connection)
+{
+	typedef std::pair<ConnectionIndex::iterator, ConnectionIndex::iterator> Range;
+
+	const boost::shared_ptr<Connectable> src = connection->source().lock();
+	const boost::shared_ptr<Connectable> dst = connection->dest().lock();
+
+	if (src && dst) {
+		const Range r = _connection_index.equal_range(ConnectionKey(src.get(), dst.get()));
+		for (ConnectionIndex::iterator e = r.first; e != r.second; ++e)
+			if (*e->second == connection)
+				return e;
+	} else {
+		// An endpoint is gone, so the key is unknown, search the slow way
+		for (ConnectionIndex::iterator e = _connection_index.begin();
+				e != _connection_index.end(); ++e)
+			if (*e->second == connection)
+				return e;
+	}
+
+	return _connection_index.end();
+}
+
+
+/** Deleter for pooled connections, which returns them to the canvas pool. */
+struct Canvas::RecycleConnection {
+	explicit RecycleConnection(boost::weak_ptr<Canvas> c) : canvas(c) {}
+
+	void operator()(Connection* c) const {
+		boost::shared_ptr<Canvas> cv = canvas.lock();
+		if (cv)
+			cv->recycle_connection(c);
+		else
+			delete c;
+	}
+
+	boost::weak_ptr<Canvas> canvas;
+};
+
+
+/** Set the number of removed connections kept for reuse.
+ *
+ * When this is non-zero, connections made by add_connection(tail, head,
+ * color) are hidden rather than destroyed when removed, and are reused by
+ * later calls.  A reused connection keeps its canvas items and path, so
+ * once the pool is warm connecting and disconnecting creates no canvas
+ * items.  The canvas and the endpoints still allocate a few small nodes per
+ * connection to index it (see bench/connection_churn.cpp for a count).
+ * Applications that enable this must not connect to signals of those
+ * connections, since a reused connection keeps them.
+ * The default is 0 (no pooling).
+ */
+void
+Canvas::set_connection_pool_size(size_t n)
+{
+	_connection_pool_size = n;
+	while (_spare_connections.size() > n) {
+		delete _spare_connections.back();
+		_spare_connections.pop_back();
+	}
+}
+
+
+void
+Canvas::recycle_connection(Connection* c)
+{
+	forget_updates(c);
+	if (_spare_connections.size() < _connection_pool_size) {
+		c->recycle();
+		_spare_connections.push_back(c);
+	} else {
+		delete c;
+	}
 }
 
 
@@ -552,11 +991,33 @@ Canvas::add_connection(boost::shared_ptr<Connectable> src,
                        boost::shared_ptr<Connectable> dst,
                        uint32_t                       color)
 {
-	// Create (graphical) connection object
-	boost::shared_ptr<Connection> c(new Connection(shared_from_this(), src, dst, color));
+	// Create (graphical) connection object, or reuse a pooled one
+	boost::shared_ptr<Connection> c;
+	if (_connection_pool_size > 0) {
+		Connection* connection = NULL;
+		if (_spare_connections.empty()) {
+			connection = new Connection(shared_from_this(), src, dst, color);
+		} else {
+			connection = _spare_connections.back();
+			_spare_connections.pop_back();
+			connection->reset(src, dst, color);
+		}
+		c = boost::shared_ptr<Connection>(connection,
+			RecycleConnection(shared_from_this()),
+			boost::fast_pool_allocator<Connection>());
+	} else {
+		c = boost::shared_ptr<Connection>(new Connection(shared_from_this(), src, dst, color));
+	}
+
 	src->add_connection(c);
 	dst->add_connection(c);
-	_connections.push_back(c);
+	index_connection(_connections.insert(_connections.end(), c));
+	add_adjacency(c);
+	c->_id = _connection_slots.insert(c);
+	if (_detail != DETAIL_FULL)
+		c->set_detail(_detail);
+	if (_culling)
+		_shown_connections.insert(c.get());
 
 	return true;
 }
@@ -571,7 +1032,13 @@ Canvas::add_connection(boost::shared_ptr<Connection> c)
 	if (src && dst) {
 		src->add_connection(c);
 		dst->add_connection(c);
-		_connections.push_back(c);
+		index_connection(_connections.insert(_connections.end(), c));
+		add_adjacency(c);
+		c->_id = _connection_slots.insert(c);
+		if (_detail != DETAIL_FULL)
+			c->set_detail(_detail);
+		if (_culling)
+			_shown_connections.insert(c.get());
 		return true;
 	} else {
 		return false;
@@ -587,55 +1054,124 @@ Canvas::remove_connection(boost::shared_ptr<Connection> connection)
 
 	unselect_connection(connection.get());
 
-	ConnectionList::iterator i = find(_connections.begin(), _connections.end(), connection);
+	const boost::shared_ptr<Connectable> src = connection->source().lock();
+	const boost::shared_ptr<Connectable> dst = connection->dest().lock();
 
-	if (i != _connections.end()) {
-		const boost::shared_ptr<Connection> c = *i;
-
-		const boost::shared_ptr<Connectable> src = c->source().lock();
-		const boost::shared_ptr<Connectable> dst = c->dest().lock();
+	ConnectionIndex::iterator e = find_index_entry(connection);
+	if (e != _connection_index.end()) {
+		const ConnectionList::iterator i = e->second;
+		_connection_index.erase(e);
 
 		if (src)
-			src->remove_connection(c);
+			src->remove_connection(connection);
 
 		if (dst)
-			dst->remove_connection(c);
-
+			dst->remove_connection(connection);
+
+		remove_adjacency(connection);
+		forget_updates(connection.get());
+		_connection_slots.erase(connection->_id);
+		_connection_bounds->remove(connection.get());
+		_shown_connections.erase(connection.get());
+		connection->_id = ConnectionId();
 		_connections.erase(i);
 	}
 }
 
 
+/** Give @a port an id on this canvas (called by its module). */
+void
+Canvas::register_port(boost::shared_ptr<Port> port)
+{
+	if (!_port_slots.contains(port->_id))
+		port->_id = _port_slots.insert(port);
+}
+
+
+void
+Canvas::unregister_port(Port* port)
+{
+	_port_slots.erase(port->_id);
+	port->_id = PortId();
+}
+
+
+void
+Canvas::add_adjacency(boost::shared_ptr<Connection> c)
+{
+	if (c->_source_item)
+		_adjacency[c->_source_item].insert(c);
+	if (c->_dest_item)
+		_adjacency[c->_dest_item].insert(c);
+}
+
+
+void
+Canvas::remove_adjacency(boost::shared_ptr<Connection> c)
+{
+	const Item* const items[] = { c->_source_item, c->_dest_item };
+
+	for (size_t i = 0; i < 2; ++i) {
+		Adjacency::iterator a = _adjacency.find(items[i]);
+		if (a != _adjacency.end()) {
+			a->second.erase(c);
+			if (a->second.empty())
+				_adjacency.erase(a);
+		}
+	}
+}
+
+
+/** Return all connections incident to @a item.
+ *
+ * For a Module, this includes the connections of all its ports.
+ */
+const ConnectionSet&
+Canvas::item_connections(boost::shared_ptr<const Item> item) const
+{
+	static const ConnectionSet empty;
+
+	Adjacency::const_iterator a = _adjacency.find(item.get());
+	return (a != _adjacency.end()) ? a->second : empty;
+}
+
+
 void
 Canvas::selection_joined_with(boost::shared_ptr<Port> port)
 {
 	for (SelectedPorts::iterator i = _selected_ports.begin(); i != _selected_ports.end(); ++i)
-		ports_joined(*i, port);
+		ports_joined(i->first, port);
 }
 
 
 void
 Canvas::join_selection()
 {
-	vector< boost::shared_ptr<Port> > inputs;
-	vector< boost::shared_ptr<Port> > outputs;
+	typedef std::pair<unsigned, boost::shared_ptr<Port> > OrderedPort;
+
+	// Sort by selection order, so the nth input selected joins the nth output
+	vector<OrderedPort> inputs;
+	vector<OrderedPort> outputs;
 	for (SelectedPorts::iterator i = _selected_ports.begin(); i != _selected_ports.end(); ++i) {
-		if ((*i)->is_input())
-			inputs.push_back(*i);
+		if (i->first->is_input())
+			inputs.push_back(std::make_pair(i->second, i->first));
 		else
-			outputs.push_back(*i);
+			outputs.push_back(std::make_pair(i->second, i->first));
 	}
 
+	std::sort(inputs.begin(), inputs.end());
+	std::sort(outputs.begin(), outputs.end());
+
 	if (inputs.size() == 1) { // 1 -> n
 		for (size_t i = 0; i < outputs.size(); ++i)
-			ports_joined(inputs[0], outputs[i]);
+			ports_joined(inputs[0].second, outputs[i].second);
 	} else if (outputs.size() == 1) { // n -> 1
 		for (size_t i = 0; i < inputs.size(); ++i)
-			ports_joined(inputs[i], outputs[0]);
+			ports_joined(inputs[i].second, outputs[0].second);
 	} else { // n -> m
 		size_t num_to_connect = std::min(inputs.size(), outputs.size());
 		for (size_t i = 0; i < num_to_connect; ++i) {
-			ports_joined(inputs[i], outputs[i]);
+			ports_joined(inputs[i].second, outputs[i].second);
 		}
 	}
 }
@@ -855,29 +1391,192 @@ Canvas::on_parent_changed(Gtk::Widget* old_parent)
     if (get_parent())
 		_parent_event_connection = get_parent()->signal_event().connect(
 				sigc::mem_fun(*this, &Canvas::frame_event));
+
+	// Adjustments are set by a scrolled parent before it adds us
+	_hadjustment_connection.disconnect();
+	_vadjustment_connection.disconnect();
+	if (get_hadjustment())
+		_hadjustment_connection = get_hadjustment()->signal_value_changed().connect(
+				sigc::mem_fun(this, &Canvas::queue_cull));
+	if (get_vadjustment())
+		_vadjustment_connection = get_vadjustment()->signal_value_changed().connect(
+				sigc::mem_fun(this, &Canvas::queue_cull));
 }
 
 
-bool
-Canvas::frame_event(GdkEvent* ev)
+/** Enable or disable hiding of items and connections that are not visible.
+ *
+ * When enabled, anything outside the visible area (plus a margin) is hidden,
+ * so is skipped when the canvas is updated and drawn, and shown again when
+ * scrolling or zooming brings it into view.  Note this means the canvas
+ * controls the visibility of items and connections.  Disabled by default.
+ */
+void
+Canvas::set_culling(bool b)
 {
-	bool handled = false;
-	// Zoom
-	if (ev->type == GDK_SCROLL && (ev->scroll.state & GDK_CONTROL_MASK)) {
-		if (ev->scroll.direction == GDK_SCROLL_UP) {
-			set_zoom(_zoom * 1.25);
-			handled = true;
-		} else if (ev->scroll.direction == GDK_SCROLL_DOWN) {
-			set_zoom(_zoom * 0.75);
-			handled = true;
-		}
-	}
-	return handled;
-}
+	if (b == _culling)
+		return;
 
+	_culling = b;
+	_cull_idle.disconnect();
 
-bool
-Canvas::scroll_drag_handler(GdkEvent* event)
+	// Everything is shown while not culling
+	for (SlotMap<Item>::iterator i = _item_slots.begin(); i != _item_slots.end(); ++i)
+		if (!b || !_shown_items.count(i->get()))
+			(*i)->show();
+	for (SlotMap<Connection>::iterator c = _connection_slots.begin(); c != _connection_slots.end(); ++c)
+		if (!b || !_shown_connections.count(c->get()))
+			(*c)->show();
+
+	_shown_items.clear();
+	_shown_connections.clear();
+
+	if (b) {
+		for (SlotMap<Item>::iterator i = _item_slots.begin(); i != _item_slots.end(); ++i)
+			_shown_items.insert(i->get());
+		for (SlotMap<Connection>::iterator c = _connection_slots.begin(); c != _connection_slots.end(); ++c)
+			_shown_connections.insert(c->get());
+
+		_view_x1 = _view_y1 = _view_x2 = _view_y2 = 0.0;
+		cull();
+	}
+}
+
+
+/** Return true if the box (@a x1, @a y1, @a x2, @a y2) is in the culling area. */
+bool
+Canvas::in_view(double x1, double y1, double x2, double y2) const
+{
+	return (_view_x2 <= _view_x1) // area unknown, not yet allocated
+		|| Box(_view_x1, _view_y1, _view_x2, _view_y2).intersects(Box(x1, y1, x2, y2));
+}
+
+
+void
+Canvas::set_shown(Item* item, bool shown)
+{
+	if (shown) {
+		if (_shown_items.insert(item).second)
+			item->show();
+	} else if (_shown_items.erase(item)) {
+		item->hide();
+	}
+}
+
+
+void
+Canvas::set_shown(Connection* connection, bool shown)
+{
+	if (shown) {
+		if (_shown_connections.insert(connection).second)
+			connection->show();
+	} else if (_shown_connections.erase(connection)) {
+		connection->hide();
+	}
+}
+
+
+void
+Canvas::on_size_allocated(Gtk::Allocation& allocation)
+{
+	queue_cull();
+}
+
+
+/** Cull once before the canvas is next drawn, however often this is called. */
+void
+Canvas::queue_cull()
+{
+	if (_culling && !_cull_idle.connected())
+		_cull_idle = Glib::signal_idle().connect(
+			sigc::mem_fun(this, &Canvas::cull), Glib::PRIORITY_HIGH_IDLE);
+}
+
+
+/** Show what is in the visible area and hide everything else.
+ *
+ * Only what is newly shown or hidden is touched, so scrolling is
+ * proportional to what is visible rather than the size of the canvas.
+ */
+bool
+Canvas::cull()
+{
+	_cull_idle.disconnect();
+	if (!_culling)
+		return false;
+
+	static const int margin = 64; // pixels
+
+	const Gtk::Allocation allocation = get_allocation();
+	if (allocation.get_width() <= 1 || allocation.get_height() <= 1)
+		return false; // not allocated yet
+
+	int scroll_x, scroll_y;
+	get_scroll_offsets(scroll_x, scroll_y);
+
+	double x1, y1, x2, y2;
+	c2w(scroll_x - margin, scroll_y - margin, x1, y1);
+	c2w(scroll_x + allocation.get_width() + margin,
+	    scroll_y + allocation.get_height() + margin, x2, y2);
+
+	if (x1 == _view_x1 && y1 == _view_y1 && x2 == _view_x2 && y2 == _view_y2)
+		return false;
+
+	_view_x1 = x1;
+	_view_y1 = y1;
+	_view_x2 = x2;
+	_view_y2 = y2;
+
+	const Box view(x1, y1, x2, y2);
+
+	std::vector<Item*> items;
+	_item_index->find(view, items);
+	ShownItems shown_items(items.begin(), items.end());
+	for (ShownItems::iterator i = _shown_items.begin(); i != _shown_items.end(); ++i)
+		if (!shown_items.count(*i))
+			(*i)->hide();
+	for (ShownItems::iterator i = shown_items.begin(); i != shown_items.end(); ++i)
+		if (!_shown_items.count(*i))
+			(*i)->show();
+	_shown_items.swap(shown_items);
+
+	std::vector<Connection*> connections;
+	_connection_bounds->find(view, connections);
+	ShownConnections shown_connections(connections.begin(), connections.end());
+	for (ShownConnections::iterator c = _shown_connections.begin(); c != _shown_connections.end(); ++c)
+		if (!shown_connections.count(*c) && _connection_bounds->contains(*c))
+			(*c)->hide();
+		else
+			shown_connections.insert(*c); // not routed yet, leave shown
+	for (ShownConnections::iterator c = shown_connections.begin(); c != shown_connections.end(); ++c)
+		if (!_shown_connections.count(*c))
+			(*c)->show();
+	_shown_connections.swap(shown_connections);
+
+	return false;
+}
+
+
+bool
+Canvas::frame_event(GdkEvent* ev)
+{
+	bool handled = false;
+	// Zoom
+	if (ev->type == GDK_SCROLL && (ev->scroll.state & GDK_CONTROL_MASK)) {
+		if (ev->scroll.direction == GDK_SCROLL_UP) {
+			set_zoom(_zoom * 1.25);
+			handled = true;
+		} else if (ev->scroll.direction == GDK_SCROLL_DOWN) {
+			set_zoom(_zoom * 0.75);
+			handled = true;
+		}
+	}
+	return handled;
+}
+
+
+bool
+Canvas::scroll_drag_handler(GdkEvent* event)
 {
 	bool handled = true;
 
@@ -932,16 +1631,28 @@ Canvas::scroll_drag_handler(GdkEvent* event)
 }
 
 
+/** Return the box with corners (@a x1, @a y1) and (@a x2, @a y2). */
+static inline Box
+normal_box(double x1, double y1, double x2, double y2)
+{
+	return Box(std::min(x1, x2), std::min(y1, y2),
+	           std::max(x1, x2), std::max(y1, y2));
+}
+
+
 bool
 Canvas::select_drag_handler(GdkEvent* event)
 {
-	boost::shared_ptr<Item> module;
+	static double origin_x = 0;
+	static double origin_y = 0;
 
 	if (event->type == GDK_BUTTON_PRESS && event->button.button == 1) {
 		assert(_select_rect == NULL);
 		_drag_state = SELECT;
 		if ( !(event->button.state & (GDK_CONTROL_MASK | GDK_SHIFT_MASK)) )
 			clear_selection();
+		origin_x = event->button.x;
+		origin_y = event->button.y;
 		_select_rect = new Gnome::Canvas::Rect(*root(),
 			event->button.x, event->button.y, event->button.x, event->button.y);
 		_select_rect->property_fill_color_rgba() = 0x273344FF;
@@ -966,17 +1677,27 @@ Canvas::select_drag_handler(GdkEvent* event)
 		}
 		_select_rect->property_x2() = x;
 		_select_rect->property_y2() = y;
+
+		if (_live_select)
+			update_select_preview(origin_x, origin_y, x, y);
+
 		return true;
 	} else if (event->type == GDK_BUTTON_RELEASE && _drag_state == SELECT) {
+		clear_select_preview();
+
 		// Select all modules within rect
-		for (ItemList::iterator i = _items.begin(); i != _items.end(); ++i) {
-			module = (*i);
-			if (module->is_within(*_select_rect)) {
-				if (module->selected())
-					unselect_item(module);
-				else
-					select_item(module);
-			}
+		vector<Item*> within;
+		_item_index->find_within(
+			normal_box(_select_rect->property_x1(), _select_rect->property_y1(),
+			           _select_rect->property_x2(), _select_rect->property_y2()),
+			within);
+
+		for (vector<Item*>::const_iterator i = within.begin(); i != within.end(); ++i) {
+			boost::shared_ptr<Item> item = (*i)->shared_from_this();
+			if (item->selected())
+				unselect_item(item);
+			else
+				select_item(item);
 		}
 
 		_base_rect.ungrab(event->button.time);
@@ -990,8 +1711,46 @@ Canvas::select_drag_handler(GdkEvent* event)
 }
 
 
-/** Updates _select_dash for rotation effect, and updates any
-  * selected item's borders (and the selection rectangle).
+/** Highlight exactly the items within the given selection rectangle.
+ *
+ * Only items that entered or left the rectangle since the last call are
+ * touched, so the cost does not depend on how many items are inside it.
+ */
+void
+Canvas::update_select_preview(double x1, double y1, double x2, double y2)
+{
+	vector<Item*> within;
+	_item_index->find_within(normal_box(x1, y1, x2, y2), within);
+
+	SelectPreview preview(within.begin(), within.end());
+
+	for (SelectPreview::const_iterator i = _select_preview.begin(); i != _select_preview.end(); ++i)
+		if (preview.find(*i) == preview.end())
+			(*i)->set_highlighted(false);
+
+	for (SelectPreview::const_iterator i = preview.begin(); i != preview.end(); ++i)
+		if (_select_preview.find(*i) == _select_preview.end())
+			(*i)->set_highlighted(true);
+
+	_select_preview.swap(preview);
+}
+
+
+void
+Canvas::clear_select_preview()
+{
+	for (SelectPreview::const_iterator i = _select_preview.begin(); i != _select_preview.end(); ++i)
+		(*i)->set_highlighted(false);
+
+	_select_preview.clear();
+}
+
+
+/** Updates _select_dash for rotation effect, and applies it to the frame
+  * around the selection.
+  *
+  * Only the frame is redrawn, so the cost of a tick does not depend on how
+  * much is selected (selected objects themselves keep a still dash).
   */
 bool
 Canvas::animate_selected()
@@ -1002,18 +1761,87 @@ Canvas::animate_selected()
 
 	_select_dash->offset = i;
 
-	for (ItemList::iterator m = _selected_items.begin();
-			m != _selected_items.end(); ++m)
-		(*m)->select_tick();
+	if (!_select_frame) {
+		_select_frame = new Gnome::Canvas::Rect(*root(), 0, 0, 0, 0);
+		_select_frame->property_outline_color_rgba() = 0xEEEEFFFF;
+		_select_frame->property_width_units() = 1.0;
+		_select_frame_dirty = true;
+	}
+
+	if (_select_frame_dirty) {
+		static const double pad = 4.0;
+
+		double left = DBL_MAX, top = DBL_MAX, right = -DBL_MAX, bottom = -DBL_MAX;
+		for (ItemSet::iterator m = _selected_items.begin();
+				m != _selected_items.end(); ++m) {
+			double x1, y1, x2, y2;
+			(*m)->world_bounds(x1, y1, x2, y2);
+			left   = std::min(left, x1);
+			top    = std::min(top, y1);
+			right  = std::max(right, x2);
+			bottom = std::max(bottom, y2);
+		}
+
+		// Connections may be selected without their items
+		for (ConnectionSet::iterator c = _selected_connections.begin();
+				c != _selected_connections.end(); ++c) {
+			Box box;
+			if (_connection_bounds->get_box(c->get(), box)) {
+				left   = std::min(left, box.x1);
+				top    = std::min(top, box.y1);
+				right  = std::max(right, box.x2);
+				bottom = std::max(bottom, box.y2);
+			}
+		}
+
+		if (left > right) {
+			_select_frame->hide(); // nothing selected has been placed yet
+			return true;
+		}
+
+		_select_frame->property_x1() = left - pad;
+		_select_frame->property_y1() = top - pad;
+		_select_frame->property_x2() = right + pad;
+		_select_frame->property_y2() = bottom + pad;
+		_select_frame->raise_to_top();
+		_select_frame->show();
+		_select_frame_dirty = false;
+	}
 
-	for (ConnectionList::iterator c = _selected_connections.begin();
-			c != _selected_connections.end(); ++c)
-		(*c)->select_tick();
+	_select_frame->property_dash() = _select_dash;
 
 	return true;
 }
 
 
+/** Note that the set of selected items has changed. */
+void
+Canvas::selection_changed()
+{
+	_select_frame_dirty = true;
+	update_select_animation();
+}
+
+
+/** Run the selection animation only while something is selected and shown.
+  */
+void
+Canvas::update_select_animation()
+{
+	const bool animate = is_mapped()
+		&& (!_selected_items.empty() || !_selected_connections.empty());
+
+	if (animate && !_animate_timeout.connected()) {
+		_animate_timeout = Glib::signal_timeout().connect(
+			sigc::mem_fun(this, &Canvas::animate_selected), 300);
+	} else if (!animate && _animate_timeout.connected()) {
+		_animate_timeout.disconnect();
+		if (_select_frame)
+			_select_frame->hide();
+	}
+}
+
+
 bool
 Canvas::connection_drag_handler(GdkEvent* event)
 {
@@ -1063,6 +1891,7 @@ Canvas::connection_drag_handler(GdkEvent* event)
 			drag_port->property_y() = 0;
 			drag_port->_rect->property_x2() = 1;
 			drag_port->_rect->property_y2() = 1;
+			drag_port->invalidate_connection_point();
 
 			if (drag_port_is_input)
 				drag_connection = boost::shared_ptr<Connection>(new Connection(
@@ -1113,6 +1942,7 @@ Canvas::connection_drag_handler(GdkEvent* event)
 				drag_port->_rect->property_x2() = 1;
 				drag_port->_rect->property_y2() = 1;
 			}
+			drag_port->invalidate_connection_point();
 			drag_connection->update_location();
 		} else { // not snapped to a port
 			assert(drag_module);
@@ -1149,6 +1979,7 @@ Canvas::connection_drag_handler(GdkEvent* event)
 				drag_module->property_x() = x;
 				drag_module->property_y() = y - 7; // FIXME: s#7#cursor_height/2#
 			}
+			drag_port->invalidate_connection_point();
 			drag_connection->update_location();
 		}
 	} else if (event->type == GDK_BUTTON_RELEASE && _drag_state == CONNECTION) {
@@ -1208,213 +2039,295 @@ Canvas::connection_drag_handler(GdkEvent* event)
 boost::shared_ptr<Port>
 Canvas::get_port_at(double x, double y)
 {
-	// Loop through every port and see if the item at these coordinates is that port
-	// (if you're thinking this is slow, stupid, and disgusting, you're right)
-	for (ItemList::const_iterator i = _items.begin(); i != _items.end(); ++i) {
-		const boost::shared_ptr<Module> m
-			= boost::dynamic_pointer_cast<Module>(*i);
-
-		if (m && m->point_is_within(x, y))
-			return m->port_at(x, y);
-
+	vector<Item*> items;
+	_item_index->find(x, y, items);
+
+	for (vector<Item*>::const_iterator i = items.begin(); i != items.end(); ++i) {
+		Module* const m = dynamic_cast<Module*>(*i);
+		if (m && m->point_is_within(x, y)) {
+			boost::shared_ptr<Port> port = m->port_at(x, y);
+			if (port)
+				return port;
+		}
 	}
+
 	return boost::shared_ptr<Port>();
 }
 
 
-#ifdef HAVE_AGRAPH
-class GVNodes : public std::map<boost::shared_ptr<Item>, Agnode_t*> {
-public:
-	GVNodes() : gvc(0), G(0) {}
-
-	void cleanup() {
-		gvFreeLayout(gvc, G);
-		agclose (G);
-		gvc = 0;
-		G = 0;
-	}
+/** Copy everything on the canvas that matters for layout into @a graph. */
+void
+Canvas::build_layout_graph(LayoutGraph& graph, bool use_length_hints) const
+{
+	typedef boost::unordered_map<const Item*, unsigned> NodeIndex;
+	NodeIndex index;
 
-	GVC_t*    gvc;
-	Agraph_t* G;
-};
-#else
-class GVNodes : public std::map<boost::shared_ptr<Item>, void*> {};
-#endif
+	graph.horizontal       = (_direction == HORIZONTAL);
+	graph.use_length_hints = use_length_hints;
+	graph.nodes.reserve(_items.size());
 
+	for (ItemList::const_iterator i = _items.begin(); i != _items.end(); ++i) {
+		const bool is_module = (dynamic_cast<const Module*>(i->get()) != NULL);
+		index.insert(std::make_pair(i->get(), graph.nodes.size()));
+		graph.nodes.push_back(LayoutGraph::Node(
+			(*i)->id(), (*i)->width(), (*i)->height(), is_module, (*i)->name()));
+
+		// Start from the current position, for layouts that refine it
+		graph.nodes.back().x = (*i)->property_x() + (*i)->width() / 2.0;
+		graph.nodes.back().y = (*i)->property_y() + (*i)->height() / 2.0;
+	}
 
-GVNodes
-Canvas::layout_dot(bool use_length_hints, const std::string& filename)
-{
-	GVNodes nodes;
+	for (ConnectionList::const_iterator i = _connections.begin(); i != _connections.end(); ++i) {
+		const boost::shared_ptr<Connection> c = *i;
 
-#ifdef HAVE_AGRAPH
-	/* FIXME: Are the strdup's here a leak?
-	 * GraphViz documentation disagrees with function prototypes.
-	 */
+		if (!c->_source_item || !c->_dest_item || !c->source().lock() || !c->dest().lock())
+			continue;
 
-	GVC_t* gvc = gvContext();
-	Agraph_t* G = agopen((char*)"g", AGDIGRAPH);
+		NodeIndex::const_iterator src_i = index.find(c->_source_item);
+		NodeIndex::const_iterator dst_i = index.find(c->_dest_item);
 
-	nodes.gvc = gvc;
-	nodes.G = G;
+		assert(src_i != index.end() && dst_i != index.end());
 
-	if (_direction == HORIZONTAL)
-		agraphattr(G, (char*)"rankdir", (char*)"LR");
-	else
-		agraphattr(G, (char*)"rankdir", (char*)"TD");
+		graph.edges.push_back(LayoutGraph::Edge(src_i->second, dst_i->second, c->length_hint()));
+	}
 
-	unsigned id = 0;
 	for (ItemList::const_iterator i = _items.begin(); i != _items.end(); ++i) {
-		std::ostringstream ss;
-		ss << "n" << id++;
-		Agnode_t* node = agnode(G, strdup(ss.str().c_str()));
-		if (boost::dynamic_pointer_cast<Module>(*i)) {
-			ss.str("");
-			ss << (*i)->width() / 96.0;
-			agsafeset(node, (char*)"width", strdup(ss.str().c_str()), (char*)"");
-			ss.str("");
-			ss << (*i)->height() / 96.0;
-			agsafeset(node, (char*)"height", strdup(ss.str().c_str()), (char*)"");
-			agsafeset(node, (char*)"shape", (char*)"box", (char*)"");
-			agsafeset(node, (char*)"label", (char*)(*i)->name().c_str(), (char*)"");
-		} else {
-			agsafeset(node, (char*)"width", (char*)"1.0", (char*)"");
-			agsafeset(node, (char*)"height", (char*)"1.0", (char*)"");
-			agsafeset(node, (char*)"shape", (char*)"ellipse", (char*)"");
-			agsafeset(node, (char*)"label", (char*)(*i)->name().c_str(), (char*)"");
+		boost::shared_ptr<Item> partner = (*i)->partner().lock();
+		if (partner) {
+			NodeIndex::const_iterator p = index.find(partner.get());
+			if (p != index.end())
+				graph.nodes[index[i->get()]].partner = p->second;
 		}
-		assert(node);
-		nodes.insert(std::make_pair(*i, node));
 	}
+}
 
-	for (ConnectionList::iterator i = _connections.begin(); i != _connections.end(); ++i) {
-		const boost::shared_ptr<Connection> c = *i;
-
-		boost::shared_ptr<Port> src_port = boost::dynamic_pointer_cast<Port>(c->source().lock());
-		boost::shared_ptr<Port> dst_port = boost::dynamic_pointer_cast<Port>(c->dest().lock());
-		boost::shared_ptr<Item> src_item = boost::dynamic_pointer_cast<Item>(c->source().lock());
-		boost::shared_ptr<Item> dst_item = boost::dynamic_pointer_cast<Item>(c->dest().lock());
 
-		GVNodes::iterator src_i = src_port
-			? nodes.find(src_port->module().lock())
-			: nodes.find(src_item);
+/** Move items to the positions in @a graph, which has been laid out.
+ *
+ * Each item is moved once, straight to its final position, so that ports
+ * and connections follow it.
+ */
+void
+Canvas::apply_layout(const LayoutGraph& graph, bool center)
+{
+	double least_x=HUGE_VAL, least_y=HUGE_VAL, most_x=0, most_y=0;
 
-		GVNodes::iterator dst_i = dst_port
-			? nodes.find(dst_port->module().lock())
-			: nodes.find(dst_item);
+	bool found = false;
+	for (vector<LayoutGraph::Node>::const_iterator n = graph.nodes.begin();
+			n != graph.nodes.end(); ++n) {
+		if (!_item_slots.contains(n->id))
+			continue; // removed since the graph was built
+
+		least_x = std::min(least_x, n->x);
+		least_y = std::min(least_y, n->y);
+		most_x  = std::max(most_x, n->x);
+		most_y  = std::max(most_y, n->y);
+		found = true;
+	}
 
-		assert(src_i != nodes.end() && dst_i != nodes.end());
+	if (!found)
+		return;
 
-		Agnode_t* src_node = src_i->second;
-		Agnode_t* dst_node = dst_i->second;
+	const double graph_width  = most_x - least_x;
+	const double graph_height = most_y - least_y;
 
-		assert(src_node && dst_node);
+	//cerr << "CWH: " << _width << ", " << _height << endl;
+	//cerr << "GWH: " << graph_width << ", " << graph_height << endl;
 
-		Agedge_t* edge = agedge(G, src_node, dst_node);
+	if (graph_width + 10 > _width)
+		resize(graph_width + 10, _height);
 
-		if (use_length_hints && c->length_hint() != 0) {
-			std::ostringstream len_ss;
-			len_ss << c->length_hint();
-			agsafeset(edge, (char*)"minlen", strdup(len_ss.str().c_str()), (char*)"1.0");
-		}
-	}
+	if (graph_height + 10 > _height)
+		resize(_width, graph_height + 10);
 
-	// Add edges between partners to have them lined up as if they are connected
-	for (GVNodes::iterator i = nodes.begin(); i != nodes.end(); ++i) {
-		boost::shared_ptr<Item> partner = i->first->partner().lock();
-		if (partner) {
-			GVNodes::iterator p = nodes.find(partner);
-			if (p != nodes.end())
-				agedge(G, i->second, p->second);
+	static const double border_width = 64.0;
+	const double x = center ? _width / 2.0 - (graph_width / 2.0) : border_width;
+	const double y = center ? _height / 2.0 - (graph_height / 2.0) : border_width;
+
+	{
+		ScopedUpdate update(*this);
+		for (vector<LayoutGraph::Node>::const_iterator n = graph.nodes.begin();
+				n != graph.nodes.end(); ++n) {
+			const boost::shared_ptr<Item> item = get_item(n->id);
+			if (item)
+				item->move(
+					x + n->x - least_x - item->width() / 2.0 - item->property_x(),
+					y + n->y - least_y - item->height() / 2.0 - item->property_y());
 		}
 	}
 
-	gvLayout(gvc, G, (char*)"dot");
-	gvRender(gvc, G, (char*)"dot", fopen("/dev/null", "w"));
-
-	if (filename != "") {
-		FILE* fd = fopen(filename.c_str(), "w");
-		gvRender(gvc, G, (char*)"dot", fd);
-		fclose(fd);
-	}
-#endif
+	if (center)
+		scroll_to_center();
+	else
+		scroll_to(0, 0);
 
-	return nodes;
+	for (ItemList::const_iterator i = _items.begin(); i != _items.end(); ++i)
+		(*i)->store_location();
 }
 
 
 void
 Canvas::render_to_dot(const string& dot_output_filename)
 {
-#ifdef HAVE_AGRAPH
-	GVNodes nodes = layout_dot(false, dot_output_filename);
-	nodes.cleanup();
-#endif
+	LayoutGraph graph;
+	build_layout_graph(graph, false);
+	layout_dot(graph, NULL, NULL, dot_output_filename);
 }
 
 
+/** Arrange everything on the canvas with the current layout engine.
+ *
+ * With LAYOUT_FORCE, items are animated into place from where they are in
+ * the main loop, so this returns immediately (and @a center is ignored).
+ */
 void
 Canvas::arrange(bool use_length_hints, bool center)
 {
-#ifdef HAVE_AGRAPH
-	GVNodes nodes = layout_dot(use_length_hints, "");
+	cancel_arrange();
 
-	double least_x=HUGE_VAL, least_y=HUGE_VAL, most_x=0, most_y=0;
+	LayoutGraph graph;
+	build_layout_graph(graph, use_length_hints);
 
-	// Set numeric locale to POSIX for reading graphviz output with strtod
-	char* locale = strdup(setlocale(LC_NUMERIC, NULL));
-	setlocale(LC_NUMERIC, "POSIX");
-
-	// Arrange to graphviz coordinates
-	for (GVNodes::iterator i = nodes.begin(); i != nodes.end(); ++i) {
-		const string pos   = agget(i->second, (char*)"pos");
-		const string x_str = pos.substr(0, pos.find(","));
-		const string y_str = pos.substr(pos.find(",")+1);
-		const double x     = strtod(x_str.c_str(), NULL) * 1.25;
-		const double y     = -strtod(y_str.c_str(), NULL) * 1.25;
-
-		i->first->property_x() = x - i->first->width()/2.0;
-		i->first->property_y() = y - i->first->height()/2.0;
-
-		least_x = std::min(least_x, x);
-		least_y = std::min(least_y, y);
-		most_x  = std::max(most_x, x);
-		most_y  = std::max(most_y, y);
+	if (_layout_engine == LAYOUT_FORCE) {
+		_force_layout  = new ForceLayout(graph);
+		_force_timeout = Glib::signal_timeout().connect(
+			sigc::mem_fun(this, &Canvas::animate_layout), 40);
+	} else if (layout(graph, _layout_engine, NULL, _dot_session)) {
+		apply_layout(graph, center);
 	}
+}
 
-	// Reset numeric locale to original value
-	setlocale(LC_NUMERIC, locale);
-	free(locale);
 
-	const double graph_width  = most_x - least_x;
-	const double graph_height = most_y - least_y;
+/** Run the force directed layout for a frame, and move items to match. */
+bool
+Canvas::animate_layout()
+{
+	static const double frame_time   = 0.015; // seconds
+	static const double border_width = 64.0;
+
+	const bool done = _force_layout->run(frame_time);
+	signal_arrange_progress.emit(_force_layout->progress());
+
+	// Keep everything on the canvas
+	double x1, y1, x2, y2;
+	_force_layout->bounds(x1, y1, x2, y2);
+	_force_layout->translate(std::max(0.0, border_width - x1),
+	                         std::max(0.0, border_width - y1));
+	_force_layout->bounds(x1, y1, x2, y2);
+	if (x2 + border_width > _width || y2 + border_width > _height)
+		resize(std::max(_width, x2 + border_width), std::max(_height, y2 + border_width));
+
+	{
+		ScopedUpdate update(*this);
+		for (size_t i = 0; i < _force_layout->size(); ++i) {
+			const boost::shared_ptr<Item> item = get_item(_force_layout->id(i));
+			if (item)
+				item->move(
+					_force_layout->x(i) - item->width() / 2.0 - item->property_x(),
+					_force_layout->y(i) - item->height() / 2.0 - item->property_y());
+		}
+	}
 
-	//cerr << "CWH: " << _width << ", " << _height << endl;
-	//cerr << "GWH: " << graph_width << ", " << graph_height << endl;
+	if (!done)
+		return true;
 
-	if (graph_width + 10 > _width)
-		resize(graph_width + 10, _height);
+	for (ItemList::const_iterator i = _items.begin(); i != _items.end(); ++i)
+		(*i)->store_location();
 
-	if (graph_height + 10 > _height)
-		resize(_width, graph_height + 10);
+	delete _force_layout;
+	_force_layout = NULL;
+
+	signal_arrange_finished.emit(true);
+	return false;
+}
 
-	nodes.cleanup();
 
-	if (center) {
-		move_contents_to_internal(
-				_width / 2.0 - (graph_width / 2.0),
-				_height / 2.0 - (graph_height / 2.0), least_x, least_y);
-		scroll_to_center();
-	} else {
-		static const double border_width = 64.0;
-		move_contents_to_internal(border_width, border_width, least_x, least_y);
-		scroll_to(0, 0);
+void
+Canvas::arrange_async(bool use_length_hints, bool center)
+{
+	cancel_arrange();
+
+	_arrange_job = new ArrangeJob(_layout_engine, center, _dot_session);
+	build_layout_graph(_arrange_job->graph, use_length_hints);
+	_arrange_job->signal_progress.connect(sigc::mem_fun(this, &Canvas::on_arrange_progress));
+	_arrange_job->signal_done.connect(sigc::mem_fun(this, &Canvas::on_arrange_done));
+
+	if (!_arrange_job->start())
+		_arrange_job->run(); // No threads, so just do it now
+}
+
+
+/** Stop the arrange in progress, if any.
+ *
+ * A background arrange is abandoned (its result will be ignored), and an
+ * animated one stops where it is.
+ */
+void
+Canvas::cancel_arrange()
+{
+	if (_arrange_job) {
+		abandon_arrange();
+		signal_arrange_finished.emit(false);
 	}
 
-	for (ItemList::const_iterator i = _items.begin(); i != _items.end(); ++i)
-		(*i)->store_location();
+	if (_force_layout) {
+		_force_timeout.disconnect();
+		delete _force_layout;
+		_force_layout = NULL;
+		signal_arrange_finished.emit(false);
+	}
+}
+
+
+void
+Canvas::on_arrange_progress()
+{
+	if (_arrange_job)
+		signal_arrange_progress.emit(_arrange_job->progress());
+}
+
+
+void
+Canvas::on_arrange_done()
+{
+	if (!_arrange_job)
+		return;
+
+	ArrangeJob* const job = _arrange_job;
+	_arrange_job = NULL;
+
+	const bool succeeded = job->succeeded && !job->cancelled();
+	if (succeeded)
+		apply_layout(job->graph, job->center);
 
-#endif
+	job->release();
+
+	signal_arrange_finished.emit(succeeded);
+}
+
+
+/** Cancel the background arrange, if any, without waiting for it.
+ *
+ * Layout can not be interrupted, so the job is left to finish on its own
+ * and its result is discarded.  It may still be using the graphviz state,
+ * so that goes with it, and the next arrange with dot starts afresh.
+ */
+void
+Canvas::abandon_arrange()
+{
+	if (!_arrange_job)
+		return;
+
+	_arrange_job->cancel();
+
+	DotSession* session = NULL;
+	if (_arrange_job->engine == LAYOUT_DOT) {
+		session      = _dot_session;
+		_dot_session = new DotSession();
+	}
+
+	_arrange_job->release(session);
+	_arrange_job = NULL;
 }
 
 
@@ -1433,6 +2346,7 @@ Canvas::move_contents_to(double x, double y)
 void
 Canvas::move_contents_to_internal(double x, double y, double min_x, double min_y)
 {
+	ScopedUpdate update(*this);
 	for (ItemList::const_iterator i = _items.begin(); i != _items.end(); ++i)
 		(*i)->move(x - min_x, y - min_y);
 }
@@ -1442,21 +2356,147 @@ void
 Canvas::resize(double width, double height)
 {
 	if (width != _width || height != _height) {
-		_base_rect.property_x2() = _base_rect.property_x1() + width;
-		_base_rect.property_y2() = _base_rect.property_y1() + height;
 		_width = width;
 		_height = height;
-		set_scroll_region(0.0, 0.0, width, height);
+		if (_update_depth > 0)
+			_resize_pending = true;
+		else
+			apply_size();
+	}
+}
+
+
+/** Set the background, scroll region, and index bounds to the canvas size. */
+void
+Canvas::apply_size()
+{
+	_base_rect.property_x2() = _base_rect.property_x1() + _width;
+	_base_rect.property_y2() = _base_rect.property_y1() + _height;
+	set_scroll_region(0.0, 0.0, _width, _height);
+
+	// Grow the indices geometrically, rebuilding them is linear
+	const Box& bounds = _item_index->bounds();
+	if (_width > bounds.x2 || _height > bounds.y2) {
+		const Box new_bounds(0.0, 0.0,
+			std::max(_width, bounds.x2 * 2.0), std::max(_height, bounds.y2 * 2.0));
+		_item_index->set_bounds(new_bounds);
+		_connection_bounds->set_bounds(new_bounds);
 	}
+
+	_resize_pending = false;
 }
 
 
 void
 Canvas::resize_all_items()
 {
-	for (ItemList::const_iterator i = _items.begin(); i != _items.end(); ++i)
+	ScopedUpdate update(*this);
+	for (SlotMap<Item>::const_iterator i = _item_slots.begin(); i != _item_slots.end(); ++i)
 		(*i)->resize();
 }
 
 
+/** Begin a batch of changes to the canvas.
+ *
+ * Until the matching call to end_update(), module resizes, connection
+ * routing, and canvas size changes are only recorded.  end_update() then
+ * does each of them once, no matter how many times they were requested.
+ * Calls may be nested, changes are applied when the outermost ends.
+ */
+void
+Canvas::begin_update()
+{
+	++_update_depth;
+}
+
+
+void
+Canvas::end_update()
+{
+	assert(_update_depth > 0);
+	if (--_update_depth > 0)
+		return;
+
+	// Resize modules, still deferring the routing and canvas size they change
+	++_update_depth;
+	_resizing_items = true;
+	while (!_dirty_modules.empty()) {
+		DirtyModules modules;
+		modules.swap(_dirty_modules);
+		for (DirtyModules::const_iterator m = modules.begin(); m != modules.end(); ++m)
+			(*m)->resize();
+	}
+	_resizing_items = false;
+	--_update_depth;
+
+	update_connections();
+
+	if (_resize_pending)
+		apply_size();
+}
+
+
+/** Record that @a module needs resizing, if an update is in progress.
+ * @return true iff the resize was deferred.
+ */
+bool
+Canvas::defer_resize(Module* module)
+{
+	if (_update_depth == 0 || _resizing_items)
+		return false;
+
+	_dirty_modules.insert(module);
+	return true;
+}
+
+
+/** Record that @a connection needs routing.
+ *
+ * Dirty connections are routed at the end of the current update, or from an
+ * idle callback that runs before the canvas redraws, so moving an endpoint
+ * many times in a frame only routes each connection once.
+ */
+void
+Canvas::defer_update_location(Connection* connection)
+{
+	_dirty_connections.insert(connection);
+
+	if (_update_depth == 0 && !_update_connections_idle.connected())
+		_update_connections_idle = Glib::signal_idle().connect(
+			sigc::mem_fun(this, &Canvas::update_connections),
+			Glib::PRIORITY_HIGH_IDLE);
+}
+
+
+/** Route all dirty connections.
+ * @return false, so this is only called once per idle scheduled.
+ */
+bool
+Canvas::update_connections()
+{
+	_update_connections_idle.disconnect();
+
+	DirtyConnections connections;
+	connections.swap(_dirty_connections);
+	for (DirtyConnections::const_iterator c = connections.begin(); c != connections.end(); ++c)
+		(*c)->update_path();
+
+	return false;
+}
+
+
+void
+Canvas::forget_updates(Module* module)
+{
+	_dirty_modules.erase(module);
+}
+
+
+void
+Canvas::forget_updates(Connection* connection)
+{
+	_dirty_connections.erase(connection);
+}
+
+
 } // namespace FlowCanvas
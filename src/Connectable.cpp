@@ -15,7 +15,7 @@
  * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301, USA
  */
 
-#include <list>
+#include <cassert>
 
 #include <boost/weak_ptr.hpp>
 
@@ -24,8 +24,6 @@
 #include "flowcanvas/Connectable.hpp"
 #include "flowcanvas/Connection.hpp"
 
-using std::list;
-
 namespace FlowCanvas {
 
 
@@ -33,12 +31,17 @@ namespace FlowCanvas {
 void
 Connectable::move_connections()
 {
-	for (list<boost::weak_ptr<Connection> >::iterator i = _connections.begin(); i != _connections.end(); i++) {
+	size_t expired = 0;
+	for (Connections::iterator i = _connections.begin(); i != _connections.end(); ++i) {
 		boost::shared_ptr<Connection> c = i->lock();
-		if (c) {
+		if (c)
 			c->update_location();
-		}
+		else
+			++expired;
 	}
+
+	if (expired * 2 > _connections.size())
+		compact_connections();
 }
 
 
@@ -56,13 +59,16 @@ Connectable::add_connection(boost::shared_ptr<Connection> connection)
 	assert(connection->source().lock().get() == this
 		|| connection->dest().lock().get() == this);
 
-	for (list<boost::weak_ptr<Connection> >::iterator i = _connections.begin(); i != _connections.end(); i++) {
-		boost::shared_ptr<Connection> c = (*i).lock();
-		if (c && c == connection)
-			return;
-	}
+	if (find_connection(connection.get()) != _connections.size())
+		return;
 
 	_connections.push_back(connection);
+	_addresses.push_back(connection.get());
+
+	if (_positions)
+		(*_positions)[connection.get()] = _connections.size() - 1;
+	else if (_connections.size() > INDEX_THRESHOLD)
+		index_connections();
 }
 
 
@@ -73,34 +79,35 @@ Connectable::add_connection(boost::shared_ptr<Connection> connection)
 void
 Connectable::remove_connection(boost::shared_ptr<Connection> c)
 {
-	for (list<boost::weak_ptr<Connection> >::iterator i = _connections.begin(); i != _connections.end(); i++) {
-		boost::shared_ptr<Connection> connection = i->lock();
-		if (connection && connection == c) {
-			_connections.erase(i);
-			break;
-		}
-	}
+	const size_t i = find_connection(c.get());
+	if (i != _connections.size())
+		erase_connection(i);
 }
 
 
 void
 Connectable::raise_connections()
 {
-	for (list<boost::weak_ptr<Connection> >::iterator i = _connections.begin(); i != _connections.end(); ++i) {
+	size_t expired = 0;
+	for (Connections::iterator i = _connections.begin(); i != _connections.end(); ++i) {
 		boost::shared_ptr<Connection> connection = (*i).lock();
 		if (connection)
 			connection->raise_to_top();
-
+		else
+			++expired;
 	}
+
+	if (expired * 2 > _connections.size())
+		compact_connections();
 }
 
 
 bool
 Connectable::is_connected_to(boost::shared_ptr<Connectable> other)
 {
-	for (list<boost::weak_ptr<Connection> >::iterator i = _connections.begin(); i != _connections.end(); ++i) {
+	for (Connections::iterator i = _connections.begin(); i != _connections.end(); ++i) {
 		boost::shared_ptr<Connection> connection = (*i).lock();
-		if (connection->source().lock() == other || connection->dest().lock() == other)
+		if (connection && (connection->source().lock() == other || connection->dest().lock() == other))
 			return true;
 	}
 
@@ -108,4 +115,94 @@ Connectable::is_connected_to(boost::shared_ptr<Connectable> other)
 }
 
 
+void
+Connectable::clear_connections()
+{
+	_connections.clear();
+	_addresses.clear();
+	_positions.reset();
+}
+
+
+/** Return the index of @a c in _connections, or its size if not found. */
+size_t
+Connectable::find_connection(const Connection* c) const
+{
+	if (_positions) {
+		// Entries may be stale (the address of an expired connection), so check
+		Positions::const_iterator p = _positions->find(c);
+		if (p != _positions->end() && p->second < _connections.size()
+				&& _connections[p->second].lock().get() == c)
+			return p->second;
+	} else {
+		for (size_t i = 0; i < _connections.size(); ++i)
+			if (_addresses[i] == c && !_connections[i].expired())
+				return i;
+	}
+
+	return _connections.size();
+}
+
+
+/** Remove the entry at @a i by moving the last entry into its place.
+ *
+ * Index entries are only changed if they refer to the entry they are keyed
+ * by, since an expired connection's address may since have been reused.
+ */
+void
+Connectable::erase_connection(size_t i)
+{
+	const size_t last = _connections.size() - 1;
+
+	if (_positions) {
+		Positions::iterator p = _positions->find(_addresses[i]);
+		if (p != _positions->end() && p->second == i)
+			_positions->erase(p);
+
+		if (i != last) {
+			p = _positions->find(_addresses[last]);
+			if (p != _positions->end() && p->second == last)
+				p->second = i;
+		}
+	}
+
+	_connections[i] = _connections[last];
+	_addresses[i]   = _addresses[last];
+	_connections.pop_back();
+	_addresses.pop_back();
+}
+
+
+void
+Connectable::index_connections()
+{
+	_positions.reset(new Positions());
+	for (size_t i = 0; i < _connections.size(); ++i)
+		if (!_connections[i].expired())
+			(*_positions)[_addresses[i]] = i;
+}
+
+
+/** Drop expired connections, and reindex if necessary. */
+void
+Connectable::compact_connections()
+{
+	size_t n = 0;
+	for (size_t i = 0; i < _connections.size(); ++i) {
+		if (!_connections[i].expired()) {
+			_connections[n] = _connections[i];
+			_addresses[n]   = _addresses[i];
+			++n;
+		}
+	}
+	_connections.resize(n);
+	_addresses.resize(n);
+
+	if (_connections.size() > INDEX_THRESHOLD)
+		index_connections();
+	else
+		_positions.reset();
+}
+
+
 } // namespace FlowCanvas
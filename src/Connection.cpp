@@ -26,10 +26,26 @@
 #include "flowcanvas/Connectable.hpp"
 #include "flowcanvas/Connection.hpp"
 #include "flowcanvas/Ellipse.hpp"
+#include "flowcanvas/Module.hpp"
+#include "flowcanvas/Port.hpp"
 
 namespace FlowCanvas {
 
 
+/** Return the item a connection endpoint is, or is on (a Port's module). */
+static Item*
+endpoint_item(Connectable* c)
+{
+	Item* item = dynamic_cast<Item*>(c);
+	if (!item) {
+		const Port* port = dynamic_cast<const Port*>(c);
+		if (port)
+			item = port->module().lock().get();
+	}
+	return item;
+}
+
+
 Connection::Connection(boost::shared_ptr<Canvas>      canvas,
 	                   boost::shared_ptr<Connectable> source,
 	                   boost::shared_ptr<Connectable> dest,
@@ -37,16 +53,19 @@ Connection::Connection(boost::shared_ptr<Canvas>      canvas,
                        bool                           show_arrowhead)
 	: Gnome::Canvas::Group(*canvas->root())
 	, _canvas(canvas)
-	, _source(source)
-	, _dest(dest)
+	, _source_item(NULL)
+	, _dest_item(NULL)
 	, _bpath(*this)
 	, _path(gnome_canvas_path_def_new())
 	, _handle(NULL)
 	, _color(color)
 	, _handle_style(HANDLE_NONE)
+	, _detail(DETAIL_FULL)
 	, _selected(false)
 	, _show_arrowhead(show_arrowhead)
 {
+	set_endpoints(source, dest);
+
 	_bpath.property_width_units() = 2.0;
 	set_color(color);
 
@@ -55,8 +74,59 @@ Connection::Connection(boost::shared_ptr<Canvas>      canvas,
 }
 
 
+/** Set the endpoints, and classify them for routing and item lookup. */
+void
+Connection::set_endpoints(boost::shared_ptr<Connectable> source,
+                          boost::shared_ptr<Connectable> dest)
+{
+	_source         = source;
+	_dest           = dest;
+	_source_item    = endpoint_item(source.get());
+	_dest_item      = endpoint_item(dest.get());
+	_straight       = (dynamic_cast<Ellipse*>(source.get()) || dynamic_cast<Ellipse*>(dest.get()));
+	_source_is_item = (_source_item && _source_item == dynamic_cast<FlowCanvas::Item*>(source.get()));
+	_dest_is_item   = (_dest_item && _dest_item == dynamic_cast<FlowCanvas::Item*>(dest.get()));
+}
+
+
+/** Reuse a recycled connection as if it was newly constructed. */
+void
+Connection::reset(boost::shared_ptr<Connectable> source,
+                  boost::shared_ptr<Connectable> dest,
+                  uint32_t                       color)
+{
+	set_endpoints(source, dest);
+
+	_handle_style   = HANDLE_NONE;
+	_detail         = DETAIL_FULL;
+	_show_arrowhead = false;
+	set_selected(false);
+	set_color(color);
+	show();
+
+	update_location();
+	raise_to_top();
+}
+
+
+/** Hide a connection that has been removed, so it can be reset() later. */
+void
+Connection::recycle()
+{
+	hide();
+	delete _handle;
+	_handle = NULL;
+	set_endpoints(boost::shared_ptr<Connectable>(), boost::shared_ptr<Connectable>());
+	_id = ConnectionId();
+}
+
+
 Connection::~Connection()
 {
+	boost::shared_ptr<Canvas> canvas = _canvas.lock();
+	if (canvas)
+		canvas->forget_updates(this);
+
 	gnome_canvas_path_def_unref(_path);
 }
 
@@ -78,10 +148,26 @@ Connection::set_color(uint32_t color)
 }
 
 
-/** Updates the path of the connection to match it's ports if they've moved.
+/** Update the path of the connection to match it's ports if they've moved.
+ *
+ * This is done once before the canvas is next drawn (or when the current
+ * canvas update ends), however many times it is called until then.
  */
 void
 Connection::update_location()
+{
+	boost::shared_ptr<Canvas> canvas = _canvas.lock();
+	if (canvas)
+		canvas->defer_update_location(this);
+	else
+		update_path();
+}
+
+
+/** Rebuild the path of the connection from the current endpoint locations.
+ */
+void
+Connection::update_path()
 {
 	boost::shared_ptr<Connectable> src = _source.lock();
 	boost::shared_ptr<Connectable> dst = _dest.lock();
@@ -89,9 +175,6 @@ Connection::update_location()
 	if (!src || !dst)
 		return;
 
-	bool straight = (boost::dynamic_pointer_cast<Ellipse>(src)
-	              || boost::dynamic_pointer_cast<Ellipse>(dst));
-
 	const Gnome::Art::Point src_point = src->src_connection_point();
 	const Gnome::Art::Point dst_point = dst->dst_connection_point(src_point);
 
@@ -100,7 +183,13 @@ Connection::update_location()
 	const double dst_x = dst_point.get_x();
 	const double dst_y = dst_point.get_y();
 
-	if (straight) {
+	// Bounding box of the path (the curve is within its control points)
+	double min_x = std::min(src_x, dst_x);
+	double min_y = std::min(src_y, dst_y);
+	double max_x = std::max(src_x, dst_x);
+	double max_y = std::max(src_y, dst_y);
+
+	if (_straight || _detail == DETAIL_MINIMAL) {
 
 		gnome_canvas_path_def_reset(_path);
 		gnome_canvas_path_def_moveto(_path, src_x, src_y);
@@ -164,6 +253,11 @@ Connection::update_location()
 		const double dst_x2 = (join_x + dst_x1) / 2.0;
 		const double dst_y2 = (join_y + dst_y1) / 2.0;
 
+		min_x = std::min(min_x, std::min(src_x1, dst_x1));
+		min_y = std::min(min_y, std::min(src_y1, dst_y1));
+		max_x = std::max(max_x, std::max(src_x1, dst_x1));
+		max_y = std::max(max_y, std::max(src_y1, dst_y1));
+
 		// libgnomecanvasmm + GTK 2.8 screwed up the Path API; use the C one.
 		gnome_canvas_path_def_reset(_path);
 		gnome_canvas_path_def_moveto(_path, src_x, src_y);
@@ -201,6 +295,12 @@ Connection::update_location()
 
 	GnomeCanvasBpath* c_obj = _bpath.gobj();
 	gnome_canvas_item_set(GNOME_CANVAS_ITEM(c_obj), "bpath", _path, NULL);
+
+	// Pad for arrowheads and handles
+	static const double pad = 16.0;
+	boost::shared_ptr<Canvas> canvas = _canvas.lock();
+	if (canvas)
+		canvas->connection_bounds_changed(this, min_x - pad, min_y - pad, max_x + pad, max_y + pad);
 }
 
 
@@ -231,6 +331,8 @@ Connection::set_label(const std::string& str)
 			show_handle(true);
 
 		_handle->text->raise(1);
+		if (_detail != DETAIL_FULL)
+			_handle->hide();
 		update_location();
 	} else if (_handle) {
 		delete _handle->text;
@@ -311,14 +413,14 @@ Connection::raise_to_top()
 	Gnome::Canvas::Item::raise_to_top();
 
 	// Raise source above us
-	boost::shared_ptr<Item> item = boost::dynamic_pointer_cast<Item>(_source.lock());
-	if (item)
-		item->raise_to_top();
+	boost::shared_ptr<Connectable> src = _source.lock();
+	if (src && _source_is_item)
+		_source_item->raise_to_top();
 
 	// Raise dest above us
-	item = boost::dynamic_pointer_cast<Item>(_dest.lock());
-	if (item)
-		item->raise_to_top();
+	boost::shared_ptr<Connectable> dst = _dest.lock();
+	if (dst && _dest_is_item)
+		_dest_item->raise_to_top();
 
 	/* Raise the roof
 	       \o/
@@ -344,5 +446,27 @@ Connection::zoom(double z)
 }
 
 
+/** Hide the label below full detail, and route straight at minimal detail. */
+void
+Connection::set_detail(DetailLevel level)
+{
+	if (level == _detail)
+		return;
+
+	const bool was_minimal = (_detail == DETAIL_MINIMAL);
+	_detail = level;
+
+	if (_handle) {
+		if (level == DETAIL_FULL)
+			_handle->show();
+		else
+			_handle->hide();
+	}
+
+	if (was_minimal || level == DETAIL_MINIMAL)
+		update_location();
+}
+
+
 } // namespace FlowCanvas
 
@@ -144,6 +144,18 @@ Ellipse::zoom(double z)
 }
 
 
+void
+Ellipse::set_detail(DetailLevel level)
+{
+	if (_label) {
+		if (_title_visible && level == DETAIL_FULL)
+			_label->show();
+		else
+			_label->hide();
+	}
+}
+
+
 void
 Ellipse::set_highlighted(bool b)
 {
@@ -178,6 +190,18 @@ Ellipse::set_selected(bool selected)
 }
 
 
+/** Get the bounding box of the ellipse (which is centered on its position).
+ */
+void
+Ellipse::world_bounds(double& x1, double& y1, double& x2, double& y2) const
+{
+	x1 = property_x() - _width / 2.0;
+	y1 = property_y() - _height / 2.0;
+	x2 = x1 + _width;
+	y2 = y1 + _height;
+}
+
+
 bool
 Ellipse::is_within(const Gnome::Canvas::Rect& rect)
 {
@@ -217,6 +241,7 @@ Ellipse::set_width(double w)
 {
 	_width = w;
 //	_ellipse.property_x2() = _ellipse.property_x1() + w;
+	bounds_changed();
 }
 
 
@@ -225,6 +250,17 @@ Ellipse::set_height(double h)
 {
 	_height = h;
 //	_ellipse.property_y2() = _ellipse.property_y1() + h;
+	bounds_changed();
+}
+
+
+/** Update the canvas index after a change in size. */
+void
+Ellipse::bounds_changed()
+{
+	boost::shared_ptr<Canvas> canvas = _canvas.lock();
+	if (canvas)
+		canvas->item_bounds_changed(this);
 }
 
 
@@ -254,6 +290,7 @@ Ellipse::move(double dx, double dy)
 		dy = canvas->height() - property_y() - _height;
 
 	Gnome::Canvas::Group::move(dx, dy);
+	canvas->item_bounds_changed(this);
 
 	move_connections();
 }
@@ -287,6 +324,7 @@ Ellipse::move_to(double x, double y)
 	property_x() = x;
 	property_y() = y;
 	Gnome::Canvas::Group::move(0, 0);
+	canvas->item_bounds_changed(this);
 
 	move_connections();
 }
@@ -0,0 +1,389 @@
+/* This file is part of FlowCanvas.
+ * Copyright (C) 2007-2009 David Robillard <http://drobilla.net>
+ *
+ * FlowCanvas is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * FlowCanvas is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+#include <vector>
+
+#include <glibmm/timer.h>
+
+#include "ForceLayout.hpp"
+
+using std::vector;
+
+namespace FlowCanvas {
+
+
+static const double   THETA     = 0.8;  ///< Barnes-Hut opening criterion
+static const double   COOLING   = 0.95; ///< Temperature factor per iteration
+static const double   GRAVITY   = 0.02; ///< Pull towards centre, keeps pieces together
+static const double   NODE_GAP  = 48.0; ///< Added to node size for ideal distance
+static const unsigned MAX_DEPTH = 24;   ///< Deeper bodies share a leaf
+
+
+ForceLayout::ForceLayout(const LayoutGraph& graph)
+	: _k(NODE_GAP)
+	, _temperature(0.0)
+	, _min_temperature(0.5)
+	, _start_temperature(0.0)
+{
+	const size_t n = graph.nodes.size();
+	_ids.reserve(n);
+	_x.reserve(n);
+	_y.reserve(n);
+	_radius.reserve(n);
+	_fx.resize(n, 0.0);
+	_fy.resize(n, 0.0);
+	_next.resize(n, unsigned(NONE));
+
+	double diameters = 0.0;
+	for (vector<LayoutGraph::Node>::const_iterator i = graph.nodes.begin();
+			i != graph.nodes.end(); ++i) {
+		_ids.push_back(i->id);
+		_x.push_back(i->x);
+		_y.push_back(i->y);
+		_radius.push_back(std::max(i->width, i->height) / 2.0);
+		diameters += _radius.back() * 2.0;
+	}
+
+	if (n > 0)
+		_k = diameters / n + NODE_GAP;
+
+	for (vector<LayoutGraph::Edge>::const_iterator e = graph.edges.begin();
+			e != graph.edges.end(); ++e) {
+		if (e->tail == e->head)
+			continue;
+
+		double length = _k;
+		if (graph.use_length_hints && e->length_hint > 1.0)
+			length *= e->length_hint;
+
+		_tails.push_back(e->tail);
+		_heads.push_back(e->head);
+		_lengths.push_back(length);
+	}
+
+	// Partners are pulled together as if connected
+	for (size_t i = 0; i < n; ++i) {
+		const unsigned partner = graph.nodes[i].partner;
+		if (partner != LayoutGraph::NONE && partner != i) {
+			_tails.push_back(i);
+			_heads.push_back(partner);
+			_lengths.push_back(_k);
+		}
+	}
+
+	// Start hot enough to untangle the initial positions
+	double x1, y1, x2, y2;
+	bounds(x1, y1, x2, y2);
+	_start_temperature = std::max(_k * 2.0, std::max(x2 - x1, y2 - y1) / 10.0);
+	_temperature       = (n > 1) ? _start_temperature : 0.0;
+}
+
+
+double
+ForceLayout::progress() const
+{
+	if (converged())
+		return 1.0;
+
+	// Temperature falls geometrically, so progress is its log
+	return log(_start_temperature / _temperature)
+		/ log(_start_temperature / _min_temperature);
+}
+
+
+void
+ForceLayout::bounds(double& x1, double& y1, double& x2, double& y2) const
+{
+	x1 = y1 = DBL_MAX;
+	x2 = y2 = -DBL_MAX;
+	for (size_t i = 0; i < _x.size(); ++i) {
+		x1 = std::min(x1, _x[i] - _radius[i]);
+		y1 = std::min(y1, _y[i] - _radius[i]);
+		x2 = std::max(x2, _x[i] + _radius[i]);
+		y2 = std::max(y2, _y[i] + _radius[i]);
+	}
+
+	if (_x.empty())
+		x1 = y1 = x2 = y2 = 0.0;
+}
+
+
+void
+ForceLayout::translate(double dx, double dy)
+{
+	const size_t n = _x.size();
+	for (size_t i = 0; i < n; ++i)
+		_x[i] += dx;
+	for (size_t i = 0; i < n; ++i)
+		_y[i] += dy;
+}
+
+
+bool
+ForceLayout::run(double seconds)
+{
+	Glib::Timer timer;
+	timer.start();
+
+	bool done = iterate();
+	while (!done && timer.elapsed() < seconds)
+		done = iterate();
+
+	return done;
+}
+
+
+bool
+ForceLayout::iterate()
+{
+	if (converged())
+		return true;
+
+	const size_t n = _x.size();
+
+	std::fill(_fx.begin(), _fx.end(), 0.0);
+	std::fill(_fy.begin(), _fy.end(), 0.0);
+
+	build_tree();
+	for (unsigned i = 0; i < n; ++i)
+		repel(i);
+
+	attract();
+
+	// Gravity towards the centre of charge
+	const double cx = _tree[0].mx;
+	const double cy = _tree[0].my;
+	for (size_t i = 0; i < n; ++i)
+		_fx[i] -= GRAVITY * (_x[i] - cx);
+	for (size_t i = 0; i < n; ++i)
+		_fy[i] -= GRAVITY * (_y[i] - cy);
+
+	// Move each node along its force, at most the current temperature
+	const double t = _temperature;
+	for (size_t i = 0; i < n; ++i) {
+		const double f = sqrt(_fx[i] * _fx[i] + _fy[i] * _fy[i]);
+		if (f > t) {
+			_fx[i] *= t / f;
+			_fy[i] *= t / f;
+		}
+	}
+	for (size_t i = 0; i < n; ++i)
+		_x[i] += _fx[i];
+	for (size_t i = 0; i < n; ++i)
+		_y[i] += _fy[i];
+
+	_temperature *= COOLING;
+	return converged();
+}
+
+
+/** Build the quadtree of all bodies, with the centre of charge of every cell. */
+void
+ForceLayout::build_tree()
+{
+	double x1, y1, x2, y2;
+	bounds(x1, y1, x2, y2);
+
+	const double half = std::max(x2 - x1, y2 - y1) / 2.0 + 1.0;
+
+	_tree.clear();
+	_tree.push_back(Cell((x1 + x2) / 2.0, (y1 + y2) / 2.0, half));
+	for (unsigned i = 0; i < _x.size(); ++i)
+		insert(i);
+
+	for (vector<Cell>::iterator c = _tree.begin(); c != _tree.end(); ++c) {
+		if (c->charge > 0.0) {
+			c->mx /= c->charge;
+			c->my /= c->charge;
+		}
+	}
+}
+
+
+void
+ForceLayout::insert(unsigned i)
+{
+	const double x = _x[i];
+	const double y = _y[i];
+
+	unsigned c     = 0;
+	unsigned depth = 0;
+	for (;;) {
+		_tree[c].charge += 1.0;
+		_tree[c].mx     += x;
+		_tree[c].my     += y;
+
+		if (!_tree[c].internal) {
+			if (_tree[c].body == NONE) {
+				_next[i]       = NONE;
+				_tree[c].body = i;
+				return;
+			} else if (depth >= MAX_DEPTH) {
+				_next[i]       = _tree[c].body;
+				_tree[c].body = i;
+				return;
+			}
+
+			// Split leaf, moving its body down
+			const unsigned b = _tree[c].body;
+			const unsigned q = ((_x[b] >= _tree[c].cx) ? 1 : 0) + ((_y[b] >= _tree[c].cy) ? 2 : 0);
+			const unsigned child = add_child(c, q);
+			_tree[child].charge = 1.0;
+			_tree[child].mx     = _x[b];
+			_tree[child].my     = _y[b];
+			_tree[child].body   = b;
+			_tree[c].body       = NONE;
+			_tree[c].internal   = true;
+		}
+
+		const unsigned q = ((x >= _tree[c].cx) ? 1 : 0) + ((y >= _tree[c].cy) ? 2 : 0);
+		unsigned child = _tree[c].child[q];
+		if (child == NONE)
+			child = add_child(c, q);
+
+		c = child;
+		++depth;
+	}
+}
+
+
+unsigned
+ForceLayout::add_child(unsigned parent, unsigned quadrant)
+{
+	const double half = _tree[parent].half / 2.0;
+	const double cx   = _tree[parent].cx + ((quadrant & 1) ? half : -half);
+	const double cy   = _tree[parent].cy + ((quadrant & 2) ? half : -half);
+
+	const unsigned child = _tree.size();
+	_tree.push_back(Cell(cx, cy, half));
+	_tree[parent].child[quadrant] = child;
+	return child;
+}
+
+
+/** Add the repulsion of all other nodes on node @a i. */
+void
+ForceLayout::repel(unsigned i)
+{
+	const double k2 = _k * _k;
+	const double x  = _x[i];
+	const double y  = _y[i];
+
+	double fx = 0.0;
+	double fy = 0.0;
+
+	_stack.clear();
+	_stack.push_back(0);
+	while (!_stack.empty()) {
+		const Cell& cell = _tree[_stack.back()];
+		_stack.pop_back();
+
+		if (cell.internal) {
+			const double dx = x - cell.mx;
+			const double dy = y - cell.my;
+			const double d2 = dx * dx + dy * dy;
+			const double w  = cell.half * 2.0;
+			if (w * w < THETA * THETA * d2) {
+				// Far enough to treat the whole cell as one body
+				fx += dx * k2 * cell.charge / d2;
+				fy += dy * k2 * cell.charge / d2;
+			} else {
+				for (unsigned q = 0; q < 4; ++q)
+					if (cell.child[q] != NONE)
+						_stack.push_back(cell.child[q]);
+			}
+			continue;
+		}
+
+		for (unsigned b = cell.body; b != NONE; b = _next[b]) {
+			if (b == i)
+				continue;
+
+			double dx = x - _x[b];
+			double dy = y - _y[b];
+			double d  = sqrt(dx * dx + dy * dy);
+			if (d < 0.01) {
+				// Coincident, push apart in an arbitrary (but fixed) direction
+				const double angle = (i * 2.399963) + b;
+				dx = cos(angle);
+				dy = sin(angle);
+				d  = 1.0;
+			}
+
+			// Repel harder when the nodes themselves overlap
+			const double gap = std::max(d - _radius[i] - _radius[b], _k * 0.1);
+			fx += dx * k2 / (d * gap);
+			fy += dy * k2 / (d * gap);
+		}
+	}
+
+	_fx[i] += fx;
+	_fy[i] += fy;
+}
+
+
+/** Add the attraction along every edge. */
+void
+ForceLayout::attract()
+{
+	const size_t n_edges = _tails.size();
+	for (size_t e = 0; e < n_edges; ++e) {
+		const unsigned t  = _tails[e];
+		const unsigned h  = _heads[e];
+		const double   dx = _x[h] - _x[t];
+		const double   dy = _y[h] - _y[t];
+		const double   d  = sqrt(dx * dx + dy * dy);
+		const double   s  = d / _lengths[e];
+
+		_fx[t] += dx * s;
+		_fy[t] += dy * s;
+		_fx[h] -= dx * s;
+		_fy[h] -= dy * s;
+	}
+}
+
+
+bool
+layout_force(LayoutGraph& graph, LayoutProgress* progress)
+{
+	ForceLayout layout(graph);
+
+	for (unsigned i = 0; !layout.iterate(); ++i) {
+		if (progress && i % 8 == 0) {
+			if (progress->cancelled())
+				return false;
+			progress->set_progress(layout.progress());
+		}
+	}
+
+	for (size_t i = 0; i < graph.nodes.size(); ++i) {
+		graph.nodes[i].x = layout.x(i);
+		graph.nodes[i].y = layout.y(i);
+	}
+
+	if (progress)
+		progress->set_progress(1.0);
+
+	return true;
+}
+
+
+} // namespace FlowCanvas
@@ -0,0 +1,111 @@
+/* This file is part of FlowCanvas.
+ * Copyright (C) 2007-2009 David Robillard <http://drobilla.net>
+ *
+ * FlowCanvas is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * FlowCanvas is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#ifndef FLOWCANVAS_FORCELAYOUT_HPP
+#define FLOWCANVAS_FORCELAYOUT_HPP
+
+#include <vector>
+
+#include <boost/utility.hpp>
+
+#include "Layout.hpp"
+
+namespace FlowCanvas {
+
+
+/** Force directed (Fruchterman-Reingold) layout of a LayoutGraph.
+ *
+ * Connected nodes attract and all nodes repel each other, and the layout
+ * cools until nodes stop moving.  Repulsion is approximated with a
+ * Barnes-Hut quadtree, so an iteration is O(n log n).  Nodes start at the
+ * positions in the graph, so the layout can be run a little at a time and
+ * shown as it goes.  Node state is kept in separate flat arrays.
+ */
+class ForceLayout : boost::noncopyable {
+public:
+	explicit ForceLayout(const LayoutGraph& graph);
+
+	/** Do one iteration.  Returns true if the layout has converged. */
+	bool iterate();
+
+	/** Iterate for about @a seconds (at least once).
+	 * Returns true if the layout has converged. */
+	bool run(double seconds);
+
+	bool     converged() const { return _temperature < _min_temperature; }
+	double   progress() const;
+	size_t   size() const      { return _x.size(); }
+	ItemId   id(size_t i) const { return _ids[i]; }
+	double   x(size_t i) const  { return _x[i]; } ///< Centre of node i
+	double   y(size_t i) const  { return _y[i]; } ///< Centre of node i
+
+	/** Get the bounding box of all nodes. */
+	void bounds(double& x1, double& y1, double& x2, double& y2) const;
+
+	/** Move everything by (@a dx, @a dy). */
+	void translate(double dx, double dy);
+
+private:
+	static const unsigned NONE = 0xFFFFFFFF;
+
+	/** A square cell of the quadtree. */
+	struct Cell {
+		Cell(double x, double y, double h)
+			: cx(x), cy(y), half(h), charge(0.0), mx(0.0), my(0.0)
+			, body(NONE), internal(false)
+		{ child[0] = child[1] = child[2] = child[3] = NONE; }
+
+		double   cx, cy;   ///< Centre of cell
+		double   half;     ///< Half of the cell's width
+		double   charge;   ///< Total charge of bodies in cell
+		double   mx, my;   ///< Centre of charge of bodies in cell
+		unsigned child[4]; ///< Index of child cells, or NONE
+		unsigned body;     ///< First body in this leaf, or NONE
+		bool     internal; ///< Has children (and no bodies)
+	};
+
+	void     build_tree();
+	void     insert(unsigned i);
+	unsigned add_child(unsigned parent, unsigned quadrant);
+	void     repel(unsigned i);
+	void     attract();
+
+	std::vector<ItemId> _ids;
+	std::vector<double> _x;      ///< Centre x of each node
+	std::vector<double> _y;      ///< Centre y of each node
+	std::vector<double> _fx;     ///< Force on each node along x
+	std::vector<double> _fy;     ///< Force on each node along y
+	std::vector<double> _radius; ///< Radius of each node
+
+	std::vector<unsigned> _next; ///< Next body in the same leaf, or NONE
+	std::vector<Cell>     _tree; ///< Quadtree cells, root first
+	std::vector<unsigned> _stack;
+
+	std::vector<unsigned> _tails;   ///< Tail node of each edge
+	std::vector<unsigned> _heads;   ///< Head node of each edge
+	std::vector<double>   _lengths; ///< Ideal length of each edge
+
+	double   _k;               ///< Ideal distance between nodes
+	double   _temperature;     ///< Maximum distance a node may move
+	double   _min_temperature; ///< Temperature at which layout is done
+	double   _start_temperature;
+};
+
+
+} // namespace FlowCanvas
+
+#endif // FLOWCANVAS_FORCELAYOUT_HPP
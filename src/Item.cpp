@@ -205,7 +205,7 @@ Item::on_drag(double dx, double dy)
 
 	// Move any other selected modules if we're selected
 	if (_selected) {
-		for (list<boost::shared_ptr<Item> >::iterator i = canvas->selected_items().begin();
+		for (ItemSet::iterator i = canvas->selected_items().begin();
 				i != canvas->selected_items().end(); ++i) {
 			(*i)->move(dx, dy);
 		}
@@ -225,7 +225,7 @@ Item::on_drop()
 		return;
 
 	if (_selected) {
-		for (list<boost::shared_ptr<Item> >::iterator i = canvas->selected_items().begin();
+		for (ItemSet::iterator i = canvas->selected_items().begin();
 				i != canvas->selected_items().end(); ++i) {
 			(*i)->store_location();
 		}
@@ -0,0 +1,745 @@
+/* This file is part of FlowCanvas.
+ * Copyright (C) 2007-2009 David Robillard <http://drobilla.net>
+ *
+ * FlowCanvas is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * FlowCanvas is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <queue>
+#include <utility>
+#include <vector>
+
+#include <stdint.h>
+
+#include <boost/utility.hpp>
+
+#include "Layout.hpp"
+
+using std::vector;
+
+namespace FlowCanvas {
+
+
+namespace {
+
+static const double   RANK_SEP   = 64.0; ///< Space between ranks
+static const double   NODE_SEP   = 16.0; ///< Space between nodes in a rank
+static const unsigned MAX_RANK_PASSES = 16; ///< Rank balancing passes
+static const unsigned MAX_SWEEPS = 12;   ///< Ordering sweeps per trial
+static const unsigned MAX_TRIALS = 4;    ///< Orderings tried (in parallel)
+
+/** Graphs smaller than this are ordered with a single trial. */
+static const size_t PARALLEL_THRESHOLD = 256;
+
+typedef vector<vector<unsigned> > Layers;
+
+
+/** Directed edge (tail, head) with a minimum rank difference. */
+struct RankEdge {
+	RankEdge(unsigned t, unsigned h, unsigned l) : tail(t), head(h), minlen(l) {}
+	unsigned tail;
+	unsigned head;
+	unsigned minlen;
+};
+
+
+/** The layered graph, with long edges split so every edge joins adjacent ranks.
+ *
+ * Nodes are those of the LayoutGraph followed by dummy nodes (one per rank
+ * crossed by a long edge).  Neighbours are stored in compressed rows.
+ */
+struct ProperGraph {
+	size_t           n_real;     ///< Number of real (not dummy) nodes
+	vector<unsigned> rank;       ///< Rank of each node
+	Layers           layers;     ///< Initial order of nodes in each rank
+	vector<unsigned> up_start;   ///< Start of each node's row in up
+	vector<unsigned> up;         ///< Neighbours in the previous rank
+	vector<unsigned> down_start; ///< Start of each node's row in down
+	vector<unsigned> down;       ///< Neighbours in the next rank
+};
+
+
+/** Build rows of @a start and @a rows from (row, value) pairs. */
+void
+build_rows(size_t                                          n_rows,
+           const vector<std::pair<unsigned, unsigned> >& pairs,
+           vector<unsigned>&                               start,
+           vector<unsigned>&                               rows)
+{
+	start.assign(n_rows + 1, 0);
+	for (size_t i = 0; i < pairs.size(); ++i)
+		++start[pairs[i].first + 1];
+	for (size_t i = 0; i < n_rows; ++i)
+		start[i + 1] += start[i];
+
+	rows.resize(pairs.size());
+	vector<unsigned> fill(start.begin(), start.end() - 1);
+	for (size_t i = 0; i < pairs.size(); ++i)
+		rows[fill[pairs[i].first]++] = pairs[i].second;
+}
+
+
+/** Make edges acyclic by reversing as few as reasonably possible.
+ *
+ * This is the greedy heuristic of Eades, Lin, and Smyth: sinks are taken
+ * off the end of a sequence of nodes and sources off the start, and when
+ * there are neither, the node with the most excess of out over in edges is
+ * put next at the start.  Edges that go backwards in the sequence are
+ * reversed.  Unlike reversing the back edges of a depth-first search, this
+ * keeps long chains pointing the same way.
+ */
+void
+break_cycles(size_t n_nodes, vector<RankEdge>& edges)
+{
+	vector<std::pair<unsigned, unsigned> > out_pairs;
+	vector<std::pair<unsigned, unsigned> > in_pairs;
+	out_pairs.reserve(edges.size());
+	in_pairs.reserve(edges.size());
+	for (unsigned i = 0; i < edges.size(); ++i) {
+		out_pairs.push_back(std::make_pair(edges[i].tail, edges[i].head));
+		in_pairs.push_back(std::make_pair(edges[i].head, edges[i].tail));
+	}
+
+	vector<unsigned> out_start, out, in_start, in;
+	build_rows(n_nodes, out_pairs, out_start, out);
+	build_rows(n_nodes, in_pairs, in_start, in);
+
+	vector<int>      in_degree(n_nodes), out_degree(n_nodes);
+	vector<bool>     removed(n_nodes, false);
+	vector<unsigned> sinks, sources;
+
+	typedef std::pair<int, unsigned> Candidate; // (out - in degree, node)
+	std::priority_queue<Candidate> candidates;
+
+	for (unsigned v = 0; v < n_nodes; ++v) {
+		in_degree[v]  = in_start[v + 1] - in_start[v];
+		out_degree[v] = out_start[v + 1] - out_start[v];
+		if (out_degree[v] == 0)
+			sinks.push_back(v);
+		else if (in_degree[v] == 0)
+			sources.push_back(v);
+		else
+			candidates.push(Candidate(out_degree[v] - in_degree[v], v));
+	}
+
+	// Position of each node in the sequence (sinks counted back from the end)
+	vector<unsigned> pos(n_nodes);
+	unsigned         head = 0;
+	unsigned         tail = n_nodes;
+
+	while (head < tail) {
+		unsigned v;
+		if (!sinks.empty()) {
+			v = sinks.back();
+			sinks.pop_back();
+			if (removed[v])
+				continue;
+			pos[v] = --tail;
+		} else if (!sources.empty()) {
+			v = sources.back();
+			sources.pop_back();
+			if (removed[v])
+				continue;
+			pos[v] = head++;
+		} else {
+			v = candidates.top().second;
+			const int delta = candidates.top().first;
+			candidates.pop();
+			if (removed[v] || delta != out_degree[v] - in_degree[v])
+				continue; // stale
+			pos[v] = head++;
+		}
+
+		removed[v] = true;
+
+		for (unsigned j = out_start[v]; j < out_start[v + 1]; ++j) {
+			const unsigned w = out[j];
+			if (!removed[w] && --in_degree[w] == 0)
+				sources.push_back(w);
+			else if (!removed[w])
+				candidates.push(Candidate(out_degree[w] - in_degree[w], w));
+		}
+
+		for (unsigned j = in_start[v]; j < in_start[v + 1]; ++j) {
+			const unsigned u = in[j];
+			if (!removed[u] && --out_degree[u] == 0)
+				sinks.push_back(u);
+			else if (!removed[u])
+				candidates.push(Candidate(out_degree[u] - in_degree[u], u));
+		}
+	}
+
+	for (vector<RankEdge>::iterator e = edges.begin(); e != edges.end(); ++e)
+		if (pos[e->tail] > pos[e->head])
+			std::swap(e->tail, e->head);
+}
+
+
+/** Assign ranks to nodes of an acyclic graph.
+ *
+ * Nodes are first placed as early as their predecessors allow, then each
+ * node is repeatedly moved to the rank that minimises the total length of
+ * its edges, which greatly reduces the number of dummy nodes needed.
+ */
+void
+assign_ranks(size_t n_nodes, const vector<RankEdge>& edges, vector<unsigned>& rank)
+{
+	vector<std::pair<unsigned, unsigned> > out_pairs;
+	vector<std::pair<unsigned, unsigned> > in_pairs;
+	out_pairs.reserve(edges.size());
+	in_pairs.reserve(edges.size());
+	for (unsigned i = 0; i < edges.size(); ++i) {
+		out_pairs.push_back(std::make_pair(edges[i].tail, i));
+		in_pairs.push_back(std::make_pair(edges[i].head, i));
+	}
+
+	vector<unsigned> out_start, out, in_start, in;
+	build_rows(n_nodes, out_pairs, out_start, out);
+	build_rows(n_nodes, in_pairs, in_start, in);
+
+	// Longest path from sources, in topological order
+	vector<unsigned> order;
+	order.reserve(n_nodes);
+	vector<unsigned> remaining(n_nodes);
+	for (unsigned v = 0; v < n_nodes; ++v) {
+		remaining[v] = in_start[v + 1] - in_start[v];
+		if (remaining[v] == 0)
+			order.push_back(v);
+	}
+
+	vector<int> r(n_nodes, 0);
+	for (size_t i = 0; i < order.size(); ++i) {
+		const unsigned v = order[i];
+		for (unsigned j = out_start[v]; j < out_start[v + 1]; ++j) {
+			const RankEdge& e = edges[out[j]];
+			r[e.head] = std::max(r[e.head], r[v] + int(e.minlen));
+			if (--remaining[e.head] == 0)
+				order.push_back(e.head);
+		}
+	}
+	assert(order.size() == n_nodes);
+
+	// Move nodes to the median of where their neighbours want them
+	vector<int> ideal;
+	for (unsigned pass = 0; pass < MAX_RANK_PASSES; ++pass) {
+		bool moved = false;
+		for (size_t i = order.size(); i-- > 0;) {
+			const unsigned v  = order[i];
+			int            lo = std::numeric_limits<int>::min();
+			int            hi = std::numeric_limits<int>::max();
+
+			ideal.clear();
+			for (unsigned j = in_start[v]; j < in_start[v + 1]; ++j) {
+				const RankEdge& e = edges[in[j]];
+				lo = std::max(lo, r[e.tail] + int(e.minlen));
+				ideal.push_back(r[e.tail] + int(e.minlen));
+			}
+			for (unsigned j = out_start[v]; j < out_start[v + 1]; ++j) {
+				const RankEdge& e = edges[out[j]];
+				hi = std::min(hi, r[e.head] - int(e.minlen));
+				ideal.push_back(r[e.head] - int(e.minlen));
+			}
+
+			if (ideal.empty())
+				continue;
+
+			// Any rank between the two middle values is optimal
+			std::sort(ideal.begin(), ideal.end());
+			const int low_median  = ideal[(ideal.size() - 1) / 2];
+			const int high_median = ideal[ideal.size() / 2];
+			const int target      = std::max(lo, std::min(hi,
+				std::max(low_median, std::min(high_median, r[v]))));
+
+			if (target != r[v]) {
+				r[v]  = target;
+				moved = true;
+			}
+		}
+
+		if (!moved)
+			break;
+	}
+
+	const int least = n_nodes ? *std::min_element(r.begin(), r.end()) : 0;
+	rank.resize(n_nodes);
+	for (size_t v = 0; v < n_nodes; ++v)
+		rank[v] = r[v] - least;
+}
+
+
+/** Split long edges, and find an initial order by depth-first search. */
+void
+make_proper(size_t                  n_nodes,
+            const vector<RankEdge>& edges,
+            const vector<unsigned>& rank,
+            ProperGraph&            graph)
+{
+	graph.n_real = n_nodes;
+	graph.rank   = rank;
+
+	vector<std::pair<unsigned, unsigned> > down_pairs;
+	down_pairs.reserve(edges.size());
+	for (vector<RankEdge>::const_iterator e = edges.begin(); e != edges.end(); ++e) {
+		unsigned tail = e->tail;
+		for (unsigned r = rank[e->tail] + 1; r < rank[e->head]; ++r) {
+			const unsigned dummy = graph.rank.size();
+			graph.rank.push_back(r);
+			down_pairs.push_back(std::make_pair(tail, dummy));
+			tail = dummy;
+		}
+		down_pairs.push_back(std::make_pair(tail, e->head));
+	}
+
+	const size_t n_total = graph.rank.size();
+
+	vector<std::pair<unsigned, unsigned> > up_pairs(down_pairs.size());
+	for (size_t i = 0; i < down_pairs.size(); ++i)
+		up_pairs[i] = std::make_pair(down_pairs[i].second, down_pairs[i].first);
+
+	build_rows(n_total, down_pairs, graph.down_start, graph.down);
+	build_rows(n_total, up_pairs, graph.up_start, graph.up);
+
+	// Initial order: depth-first preorder, so connected nodes start close
+	const unsigned n_ranks = n_total
+		? *std::max_element(graph.rank.begin(), graph.rank.end()) + 1 : 0;
+	graph.layers.assign(n_ranks, vector<unsigned>());
+
+	vector<bool>     visited(n_total, false);
+	vector<unsigned> stack;
+	for (unsigned root = 0; root < n_total; ++root) {
+		if (visited[root])
+			continue;
+
+		stack.push_back(root);
+		while (!stack.empty()) {
+			const unsigned v = stack.back();
+			stack.pop_back();
+			if (visited[v])
+				continue;
+
+			visited[v] = true;
+			graph.layers[graph.rank[v]].push_back(v);
+			for (unsigned j = graph.down_start[v + 1]; j-- > graph.down_start[v];)
+				if (!visited[graph.down[j]])
+					stack.push_back(graph.down[j]);
+		}
+	}
+}
+
+
+/** Orders nodes within ranks by repeated barycentre sweeps.
+ *
+ * Several trials with different starting orders may run at once (in
+ * different threads), and the one with the fewest crossings is used.
+ */
+class OrderTrial : boost::noncopyable {
+public:
+	OrderTrial(const ProperGraph& graph, unsigned seed, LayoutProgress* progress)
+		: crossings(std::numeric_limits<uint64_t>::max())
+		, _graph(graph)
+		, _layers(graph.layers)
+		, _pos(graph.rank.size(), 0)
+		, _key(graph.rank.size(), 0.0)
+		, _seed(seed)
+		, _progress(progress)
+	{}
+
+	void run();
+
+	Layers   best;      ///< Best order found
+	uint64_t crossings; ///< Number of crossings in best
+
+private:
+	void     shuffle();
+	void     sweep(bool down);
+	void     update_positions(unsigned r);
+	uint64_t count_crossings() const;
+
+	struct KeyLess {
+		explicit KeyLess(const vector<double>& k) : key(k) {}
+		inline bool operator()(unsigned a, unsigned b) const { return key[a] < key[b]; }
+		const vector<double>& key;
+	};
+
+	const ProperGraph& _graph;
+	Layers             _layers;
+	vector<unsigned>   _pos; ///< Position of each node in its layer
+	vector<double>     _key; ///< Sort key of each node
+	unsigned           _seed;
+	LayoutProgress*    _progress; ///< Progress to report (or NULL)
+};
+
+
+void
+OrderTrial::run()
+{
+	if (_seed != 0)
+		shuffle();
+
+	for (unsigned r = 0; r < _layers.size(); ++r)
+		update_positions(r);
+
+	best      = _layers;
+	crossings = count_crossings();
+
+	unsigned stale = 0;
+	for (unsigned i = 0; i < MAX_SWEEPS && crossings > 0 && stale < 2; ++i) {
+		if (_progress) {
+			if (_progress->cancelled())
+				return;
+			_progress->set_progress(0.2 + 0.6 * i / MAX_SWEEPS);
+		}
+
+		sweep(true);
+		sweep(false);
+
+		const uint64_t c = count_crossings();
+		if (c < crossings) {
+			best      = _layers;
+			crossings = c;
+			stale     = 0;
+		} else {
+			++stale;
+		}
+	}
+}
+
+
+/** Randomly permute every layer (deterministically, from the seed). */
+void
+OrderTrial::shuffle()
+{
+	uint32_t state = _seed;
+	for (Layers::iterator l = _layers.begin(); l != _layers.end(); ++l) {
+		for (size_t i = l->size(); i > 1; --i) {
+			state = state * 1103515245u + 12345u;
+			std::swap((*l)[i - 1], (*l)[(state >> 8) % i]);
+		}
+	}
+}
+
+
+void
+OrderTrial::update_positions(unsigned r)
+{
+	const vector<unsigned>& layer = _layers[r];
+	for (unsigned i = 0; i < layer.size(); ++i)
+		_pos[layer[i]] = i;
+}
+
+
+/** Sort each layer by the mean position of its neighbours in the previous one. */
+void
+OrderTrial::sweep(bool down)
+{
+	const vector<unsigned>& start = down ? _graph.up_start : _graph.down_start;
+	const vector<unsigned>& adj   = down ? _graph.up : _graph.down;
+
+	const unsigned n_layers = _layers.size();
+	for (unsigned i = 1; i < n_layers; ++i) {
+		const unsigned r     = down ? i : n_layers - 1 - i;
+		vector<unsigned>& layer = _layers[r];
+
+		for (vector<unsigned>::const_iterator v = layer.begin(); v != layer.end(); ++v) {
+			const unsigned begin = start[*v];
+			const unsigned end   = start[*v + 1];
+			if (begin == end) {
+				_key[*v] = _pos[*v]; // No neighbours, stay put
+				continue;
+			}
+
+			double sum = 0.0;
+			for (unsigned j = begin; j < end; ++j)
+				sum += _pos[adj[j]];
+			_key[*v] = sum / (end - begin);
+		}
+
+		std::stable_sort(layer.begin(), layer.end(), KeyLess(_key));
+		update_positions(r);
+	}
+}
+
+
+/** Count edge crossings between all adjacent layers.
+ *
+ * Edges between two layers are visited in order of their upper end, and the
+ * crossings of each are the edges already seen with a lower end further along,
+ * counted with a Fenwick tree (Barth, Juenger, and Mutzel).
+ */
+uint64_t
+OrderTrial::count_crossings() const
+{
+	uint64_t         total = 0;
+	vector<unsigned> tree;
+	vector<unsigned> ends;
+
+	for (unsigned r = 0; r + 1 < _layers.size(); ++r) {
+		const size_t n = _layers[r + 1].size();
+		tree.assign(n + 1, 0);
+		unsigned seen = 0;
+
+		const vector<unsigned>& layer = _layers[r];
+		for (vector<unsigned>::const_iterator v = layer.begin(); v != layer.end(); ++v) {
+			ends.clear();
+			for (unsigned j = _graph.down_start[*v]; j < _graph.down_start[*v + 1]; ++j)
+				ends.push_back(_pos[_graph.down[j]]);
+			std::sort(ends.begin(), ends.end());
+
+			for (vector<unsigned>::const_iterator p = ends.begin(); p != ends.end(); ++p) {
+				// Count ends seen so far at or before p
+				unsigned before = 0;
+				for (size_t k = *p + 1; k > 0; k -= k & (~k + 1))
+					before += tree[k];
+
+				total += seen - before;
+
+				for (size_t k = *p + 1; k <= n; k += k & (~k + 1))
+					++tree[k];
+				++seen;
+			}
+		}
+	}
+
+	return total;
+}
+
+
+/** Choose the order of nodes in each layer, leaving it in graph.layers.
+ * Returns false if cancelled. */
+bool
+order_layers(ProperGraph& graph, LayoutProgress* progress)
+{
+	unsigned n_trials = 1;
+	if (graph.rank.size() >= PARALLEL_THRESHOLD && Glib::thread_supported())
+		n_trials = std::max(1u, std::min(MAX_TRIALS, num_processors()));
+
+	vector<OrderTrial*> trials;
+	for (unsigned t = 0; t < n_trials; ++t)
+		trials.push_back(new OrderTrial(graph, t, (t == 0) ? progress : NULL));
+
+	// Run the first trial here, and the rest in other threads
+	vector<Glib::Thread*> threads;
+	for (unsigned t = 1; t < n_trials; ++t)
+		threads.push_back(Glib::Thread::create(
+			sigc::mem_fun(trials[t], &OrderTrial::run), true));
+
+	trials[0]->run();
+
+	for (vector<Glib::Thread*>::iterator t = threads.begin(); t != threads.end(); ++t)
+		(*t)->join();
+
+	const bool cancelled = progress && progress->cancelled();
+	if (!cancelled) {
+		OrderTrial* best = trials[0];
+		for (unsigned t = 1; t < n_trials; ++t)
+			if (trials[t]->crossings < best->crossings)
+				best = trials[t];
+		graph.layers.swap(best->best);
+	}
+
+	for (vector<OrderTrial*>::iterator t = trials.begin(); t != trials.end(); ++t)
+		delete *t;
+
+	return !cancelled;
+}
+
+
+/** A run of adjacent nodes placed together by place_layer(). */
+struct Block {
+	Block(double s, unsigned c) : sum(s), count(c) {}
+	double   mean() const { return sum / count; }
+	double   sum;
+	unsigned count;
+};
+
+
+/** Place the nodes of a layer as close as possible to @a desired positions.
+ *
+ * Nodes keep their order and do not overlap.  This is a least squares fit,
+ * solved by pooling adjacent violators: each node's position minus the
+ * space needed by the nodes before it must be non-decreasing.
+ */
+void
+place_layer(const vector<unsigned>& layer,
+            const vector<double>&   size,
+            const vector<double>&   desired,
+            vector<double>&         pos)
+{
+	vector<double> offset(layer.size(), 0.0);
+	for (size_t i = 1; i < layer.size(); ++i)
+		offset[i] = offset[i - 1] + (size[layer[i - 1]] + size[layer[i]]) / 2.0 + NODE_SEP;
+
+	vector<Block> blocks;
+	blocks.reserve(layer.size());
+	for (size_t i = 0; i < layer.size(); ++i) {
+		blocks.push_back(Block(desired[layer[i]] - offset[i], 1));
+		while (blocks.size() > 1
+				&& blocks[blocks.size() - 2].mean() > blocks.back().mean()) {
+			blocks[blocks.size() - 2].sum   += blocks.back().sum;
+			blocks[blocks.size() - 2].count += blocks.back().count;
+			blocks.pop_back();
+		}
+	}
+
+	size_t i = 0;
+	for (vector<Block>::const_iterator b = blocks.begin(); b != blocks.end(); ++b)
+		for (unsigned j = 0; j < b->count; ++j, ++i)
+			pos[layer[i]] = b->mean() + offset[i];
+}
+
+
+/** Add the positions of the neighbours of @a v in the given rows to @a sum. */
+inline void
+add_neighbours(unsigned                v,
+               const vector<unsigned>& start,
+               const vector<unsigned>& adj,
+               const vector<double>&   pos,
+               double&                 sum,
+               unsigned&               count)
+{
+	for (unsigned j = start[v]; j < start[v + 1]; ++j) {
+		sum += pos[adj[j]];
+		++count;
+	}
+}
+
+
+/** Position nodes within their layers, near their neighbours.
+ * @a size is the extent of each node across the layers. */
+void
+place_nodes(const ProperGraph& graph, const vector<double>& size, vector<double>& pos)
+{
+	const unsigned n_layers = graph.layers.size();
+
+	pos.assign(graph.rank.size(), 0.0);
+	for (unsigned r = 0; r < n_layers; ++r)
+		place_layer(graph.layers[r], size, pos, pos);
+
+	vector<double> desired(pos.size());
+	for (unsigned pass = 0; pass < 8; ++pass) {
+		const bool down = (pass % 2 == 0);
+		const bool both = (pass == 7);
+		for (unsigned i = 0; i < n_layers; ++i) {
+			const unsigned r = down ? i : n_layers - 1 - i;
+			const vector<unsigned>& layer = graph.layers[r];
+			for (vector<unsigned>::const_iterator v = layer.begin(); v != layer.end(); ++v) {
+				double   sum   = 0.0;
+				unsigned count = 0;
+				if (down || both)
+					add_neighbours(*v, graph.up_start, graph.up, pos, sum, count);
+				if (!down || both)
+					add_neighbours(*v, graph.down_start, graph.down, pos, sum, count);
+				desired[*v] = count ? sum / count : pos[*v];
+			}
+			place_layer(layer, size, desired, pos);
+		}
+	}
+}
+
+} // anonymous namespace
+
+
+bool
+layout_layered(LayoutGraph& graph, LayoutProgress* progress)
+{
+	const size_t n_nodes = graph.nodes.size();
+	if (n_nodes == 0)
+		return !(progress && progress->cancelled());
+
+	// Collect edges, lining partners up as if they were connected
+	vector<RankEdge> edges;
+	edges.reserve(graph.edges.size());
+	for (vector<LayoutGraph::Edge>::const_iterator e = graph.edges.begin();
+			e != graph.edges.end(); ++e) {
+		if (e->tail == e->head)
+			continue;
+
+		unsigned minlen = 1;
+		if (graph.use_length_hints && e->length_hint > 1.0)
+			minlen = lrint(e->length_hint);
+
+		edges.push_back(RankEdge(e->tail, e->head, minlen));
+	}
+
+	for (unsigned v = 0; v < n_nodes; ++v)
+		if (graph.nodes[v].partner != LayoutGraph::NONE && graph.nodes[v].partner != v)
+			edges.push_back(RankEdge(v, graph.nodes[v].partner, 1));
+
+	break_cycles(n_nodes, edges);
+
+	vector<unsigned> rank;
+	assign_ranks(n_nodes, edges, rank);
+
+	ProperGraph proper;
+	make_proper(n_nodes, edges, rank, proper);
+	vector<RankEdge>().swap(edges);
+
+	if (progress) {
+		if (progress->cancelled())
+			return false;
+		progress->set_progress(0.2);
+	}
+
+	if (!order_layers(proper, progress))
+		return false;
+
+	// Extent of each node along and across the direction of flow
+	const size_t n_total = proper.rank.size();
+	vector<double> along(n_total, 0.0);
+	vector<double> across(n_total, 0.0);
+	for (unsigned v = 0; v < n_nodes; ++v) {
+		const LayoutGraph::Node& n = graph.nodes[v];
+		along[v]  = graph.horizontal ? n.width : n.height;
+		across[v] = graph.horizontal ? n.height : n.width;
+	}
+
+	vector<double> cross_pos;
+	place_nodes(proper, across, cross_pos);
+
+	// Centre of each rank along the direction of flow
+	const unsigned n_layers = proper.layers.size();
+	vector<double> rank_extent(n_layers, 0.0);
+	for (unsigned v = 0; v < n_nodes; ++v)
+		rank_extent[proper.rank[v]] = std::max(rank_extent[proper.rank[v]], along[v]);
+
+	vector<double> rank_pos(n_layers, 0.0);
+	for (unsigned r = 0; r < n_layers; ++r)
+		rank_pos[r] = (r == 0) ? rank_extent[0] / 2.0
+			: rank_pos[r - 1] + (rank_extent[r - 1] + rank_extent[r]) / 2.0 + RANK_SEP;
+
+	if (progress && progress->cancelled())
+		return false;
+
+	for (unsigned v = 0; v < n_nodes; ++v) {
+		LayoutGraph::Node& n = graph.nodes[v];
+		if (graph.horizontal) {
+			n.x = rank_pos[proper.rank[v]];
+			n.y = cross_pos[v];
+		} else {
+			n.x = cross_pos[v];
+			n.y = rank_pos[proper.rank[v]];
+		}
+	}
+
+	if (progress)
+		progress->set_progress(1.0);
+
+	return true;
+}
+
+
+} // namespace FlowCanvas
@@ -0,0 +1,947 @@
+/* This file is part of FlowCanvas.
+ * Copyright (C) 2007-2009 David Robillard <http://drobilla.net>
+ *
+ * FlowCanvas is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * FlowCanvas is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <locale.h>
+#include <unistd.h>
+#ifdef __APPLE__
+#include <xlocale.h>
+#endif
+
+#include <boost/utility.hpp>
+
+#include "flowcanvas-config.h"
+#include "Layout.hpp"
+
+#ifdef HAVE_AGRAPH
+#include <gvc.h>
+#endif
+
+using std::cerr;
+using std::endl;
+using std::string;
+using std::vector;
+
+namespace FlowCanvas {
+
+
+#ifdef HAVE_AGRAPH
+
+namespace {
+
+/** Use the POSIX numeric locale in the current thread only.
+ *
+ * Graphviz reads and writes numbers with the C library, so this is needed
+ * to read them back correctly, but setlocale() would change the locale of
+ * every thread in the process (e.g. the GUI's, while it is drawing).
+ */
+class ScopedNumericLocale {
+public:
+	ScopedNumericLocale()
+		: _locale(newlocale(LC_NUMERIC_MASK, "POSIX", (locale_t)0))
+		, _old((locale_t)0)
+	{
+		if (_locale)
+			_old = uselocale(_locale);
+	}
+
+	~ScopedNumericLocale() {
+		if (_locale) {
+			uselocale(_old);
+			freelocale(_locale);
+		}
+	}
+
+private:
+	locale_t _locale;
+	locale_t _old;
+};
+
+/** Graphviz keeps global state, so only one thread may use it at a time. */
+Glib::StaticMutex graphviz_mutex = GLIBMM_STATIC_MUTEX_INIT;
+
+} // anonymous namespace
+
+#else // !HAVE_AGRAPH
+
+namespace {
+
+/** Warn, once per process, that dot layouts use the layered layout. */
+void
+warn_no_graphviz()
+{
+	static Glib::StaticMutex mutex  = GLIBMM_STATIC_MUTEX_INIT;
+	static bool              warned = false;
+
+	Glib::StaticMutex::Lock lock(mutex);
+	if (!warned) {
+		cerr << "WARNING: Built without graphviz, "
+		     << "using the layered layout instead of dot" << endl;
+		warned = true;
+	}
+}
+
+} // anonymous namespace
+
+#endif // HAVE_AGRAPH
+
+
+namespace {
+
+static const double COMPONENT_SEP = 48.0; ///< Space between packed components
+static const double PACK_ASPECT   = 1.5;  ///< Width to height of packed components
+
+
+/** Lay out a single (connected) graph with @a engine. */
+bool
+layout_component(LayoutGraph&    graph,
+                 LayoutEngine    engine,
+                 LayoutProgress* progress,
+                 DotSession*     session)
+{
+	if (graph.nodes.size() == 1) {
+		graph.nodes[0].x = graph.nodes[0].y = 0.0;
+		return !(progress && progress->cancelled());
+	}
+
+	switch (engine) {
+	case LAYOUT_DOT:
+#ifdef HAVE_AGRAPH
+		return layout_dot(graph, progress, session);
+#else
+		// No graphviz, use the layered layout instead (layout() has warned)
+		break;
+#endif
+	case LAYOUT_LAYERED:
+		break;
+	case LAYOUT_FORCE:
+		return layout_force(graph, progress);
+	}
+
+	return layout_layered(graph, progress);
+}
+
+
+unsigned
+find_root(vector<unsigned>& parent, unsigned v)
+{
+	while (parent[v] != v) {
+		parent[v] = parent[parent[v]];
+		v         = parent[v];
+	}
+	return v;
+}
+
+
+void
+join_sets(vector<unsigned>& parent, unsigned a, unsigned b)
+{
+	a = find_root(parent, a);
+	b = find_root(parent, b);
+	if (a != b)
+		parent[std::max(a, b)] = std::min(a, b);
+}
+
+
+/** Number each weakly connected component of @a graph (partners are connected).
+ * Sets the component of each node and returns the number of components. */
+unsigned
+find_components(const LayoutGraph& graph, vector<unsigned>& component)
+{
+	const unsigned n = graph.nodes.size();
+
+	vector<unsigned> parent(n);
+	for (unsigned v = 0; v < n; ++v)
+		parent[v] = v;
+
+	for (vector<LayoutGraph::Edge>::const_iterator e = graph.edges.begin();
+			e != graph.edges.end(); ++e)
+		join_sets(parent, e->tail, e->head);
+
+	for (unsigned v = 0; v < n; ++v)
+		if (graph.nodes[v].partner != LayoutGraph::NONE)
+			join_sets(parent, v, graph.nodes[v].partner);
+
+	unsigned n_components = 0;
+	component.assign(n, unsigned(LayoutGraph::NONE));
+	for (unsigned v = 0; v < n; ++v) {
+		const unsigned root = find_root(parent, v);
+		if (component[root] == LayoutGraph::NONE)
+			component[root] = n_components++;
+		component[v] = component[root];
+	}
+
+	return n_components;
+}
+
+
+/** Copy each component of @a graph into a graph of its own.
+ * Sets the index of each node within its component in @a local. */
+void
+split_components(const LayoutGraph&      graph,
+                 const vector<unsigned>& component,
+                 unsigned                n_components,
+                 vector<LayoutGraph>&    parts,
+                 vector<unsigned>&       local)
+{
+	const unsigned n = graph.nodes.size();
+
+	parts.resize(n_components);
+	for (vector<LayoutGraph>::iterator p = parts.begin(); p != parts.end(); ++p) {
+		p->horizontal       = graph.horizontal;
+		p->use_length_hints = graph.use_length_hints;
+	}
+
+	local.resize(n);
+	for (unsigned v = 0; v < n; ++v) {
+		LayoutGraph& part = parts[component[v]];
+		local[v] = part.nodes.size();
+		part.nodes.push_back(graph.nodes[v]);
+	}
+
+	for (unsigned v = 0; v < n; ++v) {
+		const unsigned partner = graph.nodes[v].partner;
+		if (partner != LayoutGraph::NONE)
+			parts[component[v]].nodes[local[v]].partner = local[partner];
+	}
+
+	for (vector<LayoutGraph::Edge>::const_iterator e = graph.edges.begin();
+			e != graph.edges.end(); ++e)
+		parts[component[e->tail]].edges.push_back(
+			LayoutGraph::Edge(local[e->tail], local[e->head], e->length_hint));
+}
+
+
+class ComponentLayouts;
+
+
+/** Progress of one component, which reports to the layout of all of them. */
+class ComponentProgress : public LayoutProgress {
+public:
+	ComponentProgress(ComponentLayouts& layouts, size_t index)
+		: _layouts(layouts), _index(index)
+	{}
+
+private:
+	void progress_changed();
+
+	ComponentLayouts& _layouts;
+	size_t            _index;
+};
+
+
+/** Lays out several components at once, with a thread per processor.
+ *
+ * Each thread takes the next component (largest first) until none are
+ * left, so many small components are spread evenly between threads.
+ * Components laid out with dot are done in the calling thread only.
+ */
+class ComponentLayouts : boost::noncopyable {
+public:
+	ComponentLayouts(vector<LayoutGraph>& parts,
+	                 LayoutEngine         engine,
+	                 LayoutProgress*      progress,
+	                 DotSession*          session);
+	~ComponentLayouts();
+
+	/** Lay out all components.  Returns false if cancelled. */
+	bool run();
+
+	void set_progress(size_t index, double progress);
+	bool cancelled() const { return _progress && _progress->cancelled(); }
+
+private:
+	void work();
+
+	vector<LayoutGraph>&       _parts;
+	vector<size_t>             _order;         ///< Parts in the order to lay them out
+	vector<ComponentProgress*> _part_progress;
+	vector<double>             _weight;        ///< Share of total work for each part
+	vector<double>             _done;          ///< Work done for each part
+	LayoutEngine               _engine;
+	LayoutProgress*            _progress;
+	DotSession*                _session;
+	Glib::Mutex                _mutex;
+	size_t                     _next;          ///< Next index into _order to lay out
+	double                     _total;         ///< Total work done
+	double                     _reported;      ///< Work done when progress was last set
+	bool                       _failed;
+};
+
+
+struct LargerPart {
+	LargerPart(const vector<double>& w) : weight(w) {}
+	bool operator()(size_t a, size_t b) const { return weight[a] > weight[b]; }
+	const vector<double>& weight;
+};
+
+
+ComponentLayouts::ComponentLayouts(vector<LayoutGraph>& parts,
+                                   LayoutEngine         engine,
+                                   LayoutProgress*      progress,
+                                   DotSession*          session)
+	: _parts(parts)
+	, _weight(parts.size(), 0.0)
+	, _done(parts.size(), 0.0)
+	, _engine(engine)
+	, _progress(progress)
+	, _session(session)
+	, _next(0)
+	, _total(0.0)
+	, _reported(0.0)
+	, _failed(false)
+{
+	double sum = 0.0;
+	for (size_t i = 0; i < parts.size(); ++i) {
+		_order.push_back(i);
+		_part_progress.push_back(new ComponentProgress(*this, i));
+		_weight[i] = parts[i].nodes.size() + parts[i].edges.size();
+		sum += _weight[i];
+	}
+
+	for (size_t i = 0; i < parts.size(); ++i)
+		_weight[i] /= sum;
+
+	std::stable_sort(_order.begin(), _order.end(), LargerPart(_weight));
+}
+
+
+ComponentLayouts::~ComponentLayouts()
+{
+	for (vector<ComponentProgress*>::iterator p = _part_progress.begin();
+			p != _part_progress.end(); ++p)
+		delete *p;
+}
+
+
+bool
+ComponentLayouts::run()
+{
+	// Graphviz only does one layout at a time (see graphviz_mutex), so dot
+	// components are laid out one after another in this thread
+	unsigned n_threads = 1;
+	if (Glib::thread_supported() && _engine != LAYOUT_DOT)
+		n_threads = std::max(1u, std::min(num_processors(), unsigned(_parts.size())));
+
+	// Work in this thread too
+	vector<Glib::Thread*> threads;
+	for (unsigned t = 1; t < n_threads; ++t)
+		threads.push_back(Glib::Thread::create(
+			sigc::mem_fun(this, &ComponentLayouts::work), true));
+
+	work();
+
+	for (vector<Glib::Thread*>::iterator t = threads.begin(); t != threads.end(); ++t)
+		(*t)->join();
+
+	return !_failed && !cancelled();
+}
+
+
+void
+ComponentLayouts::work()
+{
+	for (;;) {
+		size_t i;
+		{
+			Glib::Mutex::Lock lock(_mutex);
+			if (_failed || _next == _order.size())
+				return;
+			i = _order[_next++];
+		}
+
+		if (cancelled() || !layout_component(_parts[i], _engine, _part_progress[i], _session)) {
+			Glib::Mutex::Lock lock(_mutex);
+			_failed = true;
+			return;
+		}
+
+		set_progress(i, 1.0);
+	}
+}
+
+
+void
+ComponentLayouts::set_progress(size_t index, double progress)
+{
+	if (!_progress)
+		return;
+
+	Glib::Mutex::Lock lock(_mutex);
+	const double done = _weight[index] * progress;
+	_total += done - _done[index];
+	_done[index] = done;
+
+	// Report every percent, not every component
+	if (_total - _reported >= 0.01) {
+		_reported = _total;
+		_progress->set_progress(std::min(_total, 1.0));
+	}
+}
+
+
+void
+ComponentProgress::progress_changed()
+{
+	_layouts.set_progress(_index, progress());
+	if (_layouts.cancelled())
+		cancel();
+}
+
+
+/** Bounding box of a laid out graph. */
+struct PartBox {
+	PartBox() : index(0), x1(HUGE_VAL), y1(HUGE_VAL), x2(-HUGE_VAL), y2(-HUGE_VAL) {}
+
+	double width() const  { return x2 - x1; }
+	double height() const { return y2 - y1; }
+
+	size_t index;
+	double x1, y1, x2, y2;
+};
+
+
+struct TallerPart {
+	bool operator()(const PartBox& a, const PartBox& b) const {
+		return a.height() > b.height();
+	}
+};
+
+
+/** Pack laid out @a parts into rows, and set the positions in @a graph.
+ *
+ * Parts are placed tallest first, left to right, starting a new row when
+ * the row is full.  Rows are as wide as needed to make the whole roughly
+ * PACK_ASPECT times as wide as it is tall.
+ */
+void
+pack_components(LayoutGraph&               graph,
+                const vector<LayoutGraph>& parts,
+                const vector<unsigned>&    component,
+                const vector<unsigned>&    local)
+{
+	vector<PartBox> boxes(parts.size());
+	double area  = 0.0;
+	double widest = 0.0;
+	for (size_t p = 0; p < parts.size(); ++p) {
+		PartBox& box = boxes[p];
+		box.index = p;
+		for (vector<LayoutGraph::Node>::const_iterator n = parts[p].nodes.begin();
+				n != parts[p].nodes.end(); ++n) {
+			box.x1 = std::min(box.x1, n->x - n->width / 2.0);
+			box.y1 = std::min(box.y1, n->y - n->height / 2.0);
+			box.x2 = std::max(box.x2, n->x + n->width / 2.0);
+			box.y2 = std::max(box.y2, n->y + n->height / 2.0);
+		}
+		area  += (box.width() + COMPONENT_SEP) * (box.height() + COMPONENT_SEP);
+		widest = std::max(widest, box.width());
+	}
+
+	std::stable_sort(boxes.begin(), boxes.end(), TallerPart());
+
+	const double row_width = std::max(widest, sqrt(area * PACK_ASPECT));
+
+	vector<double> dx(parts.size(), 0.0);
+	vector<double> dy(parts.size(), 0.0);
+	double x = 0.0, y = 0.0, row_height = 0.0;
+	for (vector<PartBox>::const_iterator b = boxes.begin(); b != boxes.end(); ++b) {
+		if (x > 0.0 && x + b->width() > row_width) {
+			x          = 0.0;
+			y         += row_height + COMPONENT_SEP;
+			row_height = 0.0;
+		}
+
+		dx[b->index] = x - b->x1;
+		dy[b->index] = y - b->y1;
+		x           += b->width() + COMPONENT_SEP;
+		row_height   = std::max(row_height, b->height());
+	}
+
+	for (size_t v = 0; v < graph.nodes.size(); ++v) {
+		const unsigned           c = component[v];
+		const LayoutGraph::Node& n = parts[c].nodes[local[v]];
+		graph.nodes[v].x = n.x + dx[c];
+		graph.nodes[v].y = n.y + dy[c];
+	}
+}
+
+} // anonymous namespace
+
+
+bool
+layout(LayoutGraph& graph, LayoutEngine engine, LayoutProgress* progress, DotSession* session)
+{
+#ifndef HAVE_AGRAPH
+	if (engine == LAYOUT_DOT) {
+		warn_no_graphviz();
+		engine = LAYOUT_LAYERED;
+	}
+#endif
+
+	if (session)
+		session->begin();
+
+	vector<unsigned> component;
+	const unsigned   n_components = find_components(graph, component);
+	if (n_components <= 1) {
+		if (!layout_component(graph, engine, progress, session))
+			return false;
+	} else {
+		vector<LayoutGraph> parts;
+		vector<unsigned>    local;
+		split_components(graph, component, n_components, parts, local);
+
+		ComponentLayouts layouts(parts, engine, progress, session);
+		if (!layouts.run())
+			return false;
+
+		pack_components(graph, parts, component, local);
+	}
+
+	// Keep graphs for components that were not reached if cancelled
+	if (session)
+		session->collect();
+
+	if (progress)
+		progress->set_progress(1.0);
+
+	return true;
+}
+
+
+unsigned
+num_processors()
+{
+#ifdef _SC_NPROCESSORS_ONLN
+	const long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return (n > 0) ? n : 1;
+#else
+	return 1;
+#endif
+}
+
+
+#ifdef HAVE_AGRAPH
+
+namespace {
+
+/** A node in a session graph, for the item in the slot it is indexed by. */
+struct DotNode {
+	DotNode()
+		: node(NULL), graph(0), stamp(0), pass(0)
+		, width(0.0), height(0.0), is_module(false)
+	{}
+
+	ItemId      id;        ///< Item this node is for
+	Agnode_t*   node;      ///< Graphviz node, or NULL if none
+	unsigned    graph;     ///< Key of the graph node is in
+	unsigned    stamp;     ///< Different for every graphviz node made
+	unsigned    pass;      ///< Last layout pass node was used in
+	double      width;
+	double      height;
+	bool        is_module;
+	std::string name;
+};
+
+
+/** An edge in a session graph, between nodes indexed by item slot. */
+struct DotEdge {
+	DotEdge(unsigned t, unsigned h, double l)
+		: tail(t), head(h), tail_stamp(0), head_stamp(0), minlen(l), edge(NULL)
+	{}
+
+	inline bool operator<(const DotEdge& e) const {
+		if (tail != e.tail)
+			return tail < e.tail;
+		else if (head != e.head)
+			return head < e.head;
+		return minlen < e.minlen;
+	}
+
+	unsigned  tail;
+	unsigned  head;
+	unsigned  tail_stamp; ///< Stamp of tail node when edge was made
+	unsigned  head_stamp; ///< Stamp of head node when edge was made
+	double    minlen;     ///< Length hint, or 0
+	Agedge_t* edge;
+};
+
+
+/** A graph in a session, for one component. */
+struct DotGraph {
+	DotGraph(Agraph_t* g, bool h) : graph(g), horizontal(h), serial(0) {}
+
+	Agraph_t*        graph;
+	bool             horizontal;
+	unsigned         serial;  ///< Last layout graph was used in
+	vector<unsigned> members; ///< Nodes (by item slot) in graph
+	vector<DotEdge>  edges;   ///< Edges in graph, sorted
+};
+
+} // anonymous namespace
+
+
+struct DotSession::Impl {
+	Impl() : context(NULL), null_output(NULL), serial(0), pass(0), stamps(0) {}
+
+	DotGraph* graph_for(unsigned key, bool horizontal);
+	void      close_graph(unsigned key);
+	void      sync_nodes(DotGraph* g, unsigned key, const LayoutGraph& graph);
+	void      sync_edges(DotGraph* g, unsigned key, const LayoutGraph& graph);
+	bool      valid(const DotEdge& e, unsigned key) const;
+
+	GVC_t*            context;
+	FILE*             null_output; ///< Rendered to, which sets node positions
+	vector<DotNode>   nodes;       ///< Indexed by item slot
+	vector<DotGraph*> graphs;      ///< Indexed by lowest item slot in graph
+	unsigned          serial;      ///< Current layout
+	unsigned          pass;        ///< Current call to DotSession::layout()
+	unsigned          stamps;      ///< Last node stamp
+};
+
+
+/** Get the graph for the component with lowest item slot @a key, or make one. */
+DotGraph*
+DotSession::Impl::graph_for(unsigned key, bool horizontal)
+{
+	if (key >= graphs.size())
+		graphs.resize(key + 1, NULL);
+
+	// Direction is a graph attribute, so make a new graph if it changes
+	if (graphs[key] && graphs[key]->horizontal != horizontal)
+		close_graph(key);
+
+	if (!graphs[key]) {
+		Agraph_t* G = agopen((char*)"g", AGDIGRAPH);
+		agraphattr(G, (char*)"rankdir", horizontal ? (char*)"LR" : (char*)"TD");
+		graphs[key] = new DotGraph(G, horizontal);
+	}
+
+	return graphs[key];
+}
+
+
+void
+DotSession::Impl::close_graph(unsigned key)
+{
+	DotGraph* const g = graphs[key];
+	for (vector<unsigned>::const_iterator m = g->members.begin(); m != g->members.end(); ++m) {
+		DotNode& n = nodes[*m];
+		if (n.node && n.graph == key) {
+			n.node = NULL;
+			n.id   = ItemId();
+		}
+	}
+
+	agclose(g->graph);
+	delete g;
+	graphs[key] = NULL;
+}
+
+
+/** Add, remove, and update nodes in @a g so it matches @a graph. */
+void
+DotSession::Impl::sync_nodes(DotGraph* g, unsigned key, const LayoutGraph& graph)
+{
+	char buf[32];
+	vector<unsigned> members;
+	members.reserve(graph.nodes.size());
+	for (vector<LayoutGraph::Node>::const_iterator i = graph.nodes.begin();
+			i != graph.nodes.end(); ++i) {
+		const unsigned index = i->id.index();
+		DotNode&       n     = nodes[index];
+
+		// Remove a node for a removed item, or one that moved from another graph
+		if (n.node && (n.id != i->id || n.graph != key)) {
+			agdelete(graphs[n.graph]->graph, n.node);
+			n.node = NULL;
+		}
+
+		bool changed = false;
+		if (!n.node) {
+			snprintf(buf, sizeof(buf), "n%u", index);
+			n.node  = agnode(g->graph, buf);
+			n.id    = i->id;
+			n.graph = key;
+			n.stamp = ++stamps;
+			changed = true;
+		}
+
+		if (changed || n.width != i->width || n.height != i->height
+				|| n.is_module != i->is_module || n.name != i->name) {
+			n.width     = i->width;
+			n.height    = i->height;
+			n.is_module = i->is_module;
+			n.name      = i->name;
+			if (i->is_module) {
+				snprintf(buf, sizeof(buf), "%g", i->width / 96.0);
+				agsafeset(n.node, (char*)"width", buf, (char*)"");
+				snprintf(buf, sizeof(buf), "%g", i->height / 96.0);
+				agsafeset(n.node, (char*)"height", buf, (char*)"");
+				agsafeset(n.node, (char*)"shape", (char*)"box", (char*)"");
+			} else {
+				agsafeset(n.node, (char*)"width", (char*)"1.0", (char*)"");
+				agsafeset(n.node, (char*)"height", (char*)"1.0", (char*)"");
+				agsafeset(n.node, (char*)"shape", (char*)"ellipse", (char*)"");
+			}
+			agsafeset(n.node, (char*)"label", (char*)i->name.c_str(), (char*)"");
+		}
+
+		n.pass = pass;
+		members.push_back(index);
+	}
+
+	// Remove nodes no longer in this component
+	for (vector<unsigned>::const_iterator m = g->members.begin(); m != g->members.end(); ++m) {
+		DotNode& n = nodes[*m];
+		if (n.node && n.graph == key && n.pass != pass) {
+			agdelete(g->graph, n.node);
+			n.node = NULL;
+			n.id   = ItemId();
+		}
+	}
+
+	g->members.swap(members);
+}
+
+
+/** Return true iff the nodes of @a e are the ones it was made between.
+ * Graphviz removes edges along with their nodes. */
+bool
+DotSession::Impl::valid(const DotEdge& e, unsigned key) const
+{
+	const DotNode& t = nodes[e.tail];
+	const DotNode& h = nodes[e.head];
+	return t.node && t.graph == key && t.stamp == e.tail_stamp
+		&& h.node && h.graph == key && h.stamp == e.head_stamp;
+}
+
+
+/** Add and remove edges in @a g so it matches @a graph. */
+void
+DotSession::Impl::sync_edges(DotGraph* g, unsigned key, const LayoutGraph& graph)
+{
+	vector<DotEdge> wanted;
+	wanted.reserve(graph.edges.size());
+	for (vector<LayoutGraph::Edge>::const_iterator e = graph.edges.begin();
+			e != graph.edges.end(); ++e) {
+		const double minlen = graph.use_length_hints ? e->length_hint : 0.0;
+		wanted.push_back(DotEdge(graph.nodes[e->tail].id.index(),
+		                         graph.nodes[e->head].id.index(),
+		                         minlen));
+	}
+
+	// Add edges between partners to have them lined up as if they are connected
+	for (vector<LayoutGraph::Node>::const_iterator n = graph.nodes.begin();
+			n != graph.nodes.end(); ++n)
+		if (n->partner != LayoutGraph::NONE)
+			wanted.push_back(DotEdge(n->id.index(), graph.nodes[n->partner].id.index(), 0.0));
+
+	std::sort(wanted.begin(), wanted.end());
+
+	// Merge with the (sorted) edges already in the graph
+	vector<DotEdge> edges;
+	edges.reserve(wanted.size());
+	vector<DotEdge>::const_iterator       w = wanted.begin();
+	vector<DotEdge>::const_iterator       o = g->edges.begin();
+	const vector<DotEdge>::const_iterator o_end = g->edges.end();
+	char buf[32];
+	while (w != wanted.end() || o != o_end) {
+		if (o != o_end && !valid(*o, key)) {
+			++o; // Removed with a node
+		} else if (w == wanted.end() || (o != o_end && *o < *w)) {
+			agdelete(g->graph, o->edge);
+			++o;
+		} else if (o != o_end && !(*w < *o)) {
+			edges.push_back(*o);
+			++o;
+			++w;
+		} else {
+			DotEdge e = *w++;
+			e.tail_stamp = nodes[e.tail].stamp;
+			e.head_stamp = nodes[e.head].stamp;
+			e.edge       = agedge(g->graph, nodes[e.tail].node, nodes[e.head].node);
+			if (e.minlen != 0.0) {
+				snprintf(buf, sizeof(buf), "%g", e.minlen);
+				agsafeset(e.edge, (char*)"minlen", buf, (char*)"1.0");
+			}
+			edges.push_back(e);
+		}
+	}
+
+	g->edges.swap(edges);
+}
+
+#else
+
+struct DotSession::Impl {};
+
+#endif // HAVE_AGRAPH
+
+
+DotSession::DotSession()
+	: _impl(new Impl())
+{
+}
+
+
+DotSession::~DotSession()
+{
+#ifdef HAVE_AGRAPH
+	Glib::StaticMutex::Lock lock(graphviz_mutex);
+	for (unsigned key = 0; key < _impl->graphs.size(); ++key)
+		if (_impl->graphs[key])
+			_impl->close_graph(key);
+
+	if (_impl->context)
+		gvFreeContext(_impl->context);
+
+	if (_impl->null_output)
+		fclose(_impl->null_output);
+#endif
+
+	delete _impl;
+}
+
+
+void
+DotSession::begin()
+{
+#ifdef HAVE_AGRAPH
+	Glib::StaticMutex::Lock lock(graphviz_mutex);
+	++_impl->serial;
+#endif
+}
+
+
+void
+DotSession::collect()
+{
+#ifdef HAVE_AGRAPH
+	Glib::StaticMutex::Lock lock(graphviz_mutex);
+	for (unsigned key = 0; key < _impl->graphs.size(); ++key)
+		if (_impl->graphs[key] && _impl->graphs[key]->serial != _impl->serial)
+			_impl->close_graph(key);
+#endif
+}
+
+
+bool
+DotSession::layout(LayoutGraph& graph, LayoutProgress* progress, const string& filename)
+{
+#ifdef HAVE_AGRAPH
+	if (progress && progress->cancelled())
+		return false;
+	else if (graph.nodes.empty())
+		return true;
+
+	Glib::StaticMutex::Lock lock(graphviz_mutex);
+	ScopedNumericLocale numeric_locale;
+
+	if (!_impl->context)
+		_impl->context = gvContext();
+	if (!_impl->null_output)
+		_impl->null_output = fopen("/dev/null", "w");
+
+	// The graph for a component is found by its lowest item slot
+	unsigned key = graph.nodes[0].id.index();
+	for (vector<LayoutGraph::Node>::const_iterator n = graph.nodes.begin();
+			n != graph.nodes.end(); ++n) {
+		assert(!n->id.is_null());
+		key = std::min(key, n->id.index());
+		if (n->id.index() >= _impl->nodes.size())
+			_impl->nodes.resize(n->id.index() + 1);
+	}
+
+	++_impl->pass;
+	DotGraph* const g = _impl->graph_for(key, graph.horizontal);
+	g->serial = _impl->serial;
+	_impl->sync_nodes(g, key, graph);
+	_impl->sync_edges(g, key, graph);
+
+	if (progress)
+		progress->set_progress(0.1);
+
+	if (progress && progress->cancelled())
+		return false;
+
+	GVC_t* const    gvc = _impl->context;
+	Agraph_t* const G   = g->graph;
+	gvLayout(gvc, G, (char*)"dot");
+	if (_impl->null_output)
+		gvRender(gvc, G, (char*)"dot", _impl->null_output);
+
+	if (filename != "") {
+		FILE* fd = fopen(filename.c_str(), "w");
+		if (fd) {
+			gvRender(gvc, G, (char*)"dot", fd);
+			fclose(fd);
+		}
+	}
+
+	if (progress)
+		progress->set_progress(0.9);
+
+	// Read graphviz coordinates
+	bool ret = false;
+	if (!progress || !progress->cancelled()) {
+		for (size_t i = 0; i < graph.nodes.size(); ++i) {
+			Agnode_t* const node  = _impl->nodes[graph.nodes[i].id.index()].node;
+			const string    pos   = agget(node, (char*)"pos");
+			const string    x_str = pos.substr(0, pos.find(","));
+			const string    y_str = pos.substr(pos.find(",")+1);
+			graph.nodes[i].x = strtod(x_str.c_str(), NULL) * 1.25;
+			graph.nodes[i].y = -strtod(y_str.c_str(), NULL) * 1.25;
+		}
+		ret = true;
+	}
+
+	gvFreeLayout(gvc, G);
+
+	if (ret && progress)
+		progress->set_progress(1.0);
+
+	return ret;
+#else
+	return false;
+#endif
+}
+
+
+bool
+layout_dot(LayoutGraph&       graph,
+           LayoutProgress*    progress,
+           DotSession*        session,
+           const string&      filename)
+{
+	if (session)
+		return session->layout(graph, progress, filename);
+
+	DotSession temporary;
+	return temporary.layout(graph, progress, filename);
+}
+
+
+} // namespace FlowCanvas
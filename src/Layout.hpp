@@ -0,0 +1,204 @@
+/* This file is part of FlowCanvas.
+ * Copyright (C) 2007-2009 David Robillard <http://drobilla.net>
+ *
+ * FlowCanvas is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * FlowCanvas is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#ifndef FLOWCANVAS_LAYOUT_HPP
+#define FLOWCANVAS_LAYOUT_HPP
+
+#include <string>
+#include <vector>
+
+#include <boost/utility.hpp>
+
+#include <glibmm/thread.h>
+
+#include "flowcanvas/Item.hpp"
+#include "flowcanvas/LayoutEngine.hpp"
+
+namespace FlowCanvas {
+
+
+/** A copy of the canvas graph to lay out.
+ *
+ * This holds no references to canvas objects (items are referred to by id),
+ * so it can be laid out in another thread while the canvas changes.
+ * Nodes and edges refer to each other by index into this graph.
+ */
+struct LayoutGraph {
+	static const unsigned NONE = 0xFFFFFFFF;
+
+	struct Node {
+		Node(ItemId i, double w, double h, bool module, const std::string& n)
+			: id(i), width(w), height(h), x(0.0), y(0.0)
+			, partner(NONE), is_module(module), name(n)
+		{}
+
+		ItemId      id;
+		double      width;
+		double      height;
+		double      x;         ///< Centre, set by layout
+		double      y;         ///< Centre, set by layout
+		unsigned    partner;   ///< Index of partner node, or NONE
+		bool        is_module;
+		std::string name;
+	};
+
+	struct Edge {
+		Edge(unsigned t, unsigned h, double len) : tail(t), head(h), length_hint(len) {}
+
+		unsigned tail;
+		unsigned head;
+		double   length_hint; ///< Connection::length_hint(), or 0
+	};
+
+	LayoutGraph() : horizontal(true), use_length_hints(false) {}
+
+	std::vector<Node> nodes;
+	std::vector<Edge> edges;
+	bool              horizontal;       ///< Flow left to right (else top down)
+	bool              use_length_hints;
+};
+
+
+/** Progress of a layout, and a request to cancel it.
+ *
+ * The layout reports progress and checks for cancellation from whatever
+ * thread it runs in, while other threads read progress and cancel.
+ */
+class LayoutProgress {
+public:
+	LayoutProgress() : _progress(0.0), _cancelled(false) {}
+	virtual ~LayoutProgress() {}
+
+	/** Set the fraction of the layout done, from 0 to 1. */
+	void set_progress(double progress) {
+		{
+			Glib::Mutex::Lock lock(_mutex);
+			_progress = progress;
+		}
+		progress_changed();
+	}
+
+	double progress() const {
+		Glib::Mutex::Lock lock(_mutex);
+		return _progress;
+	}
+
+	void cancel() {
+		Glib::Mutex::Lock lock(_mutex);
+		_cancelled = true;
+	}
+
+	bool cancelled() const {
+		Glib::Mutex::Lock lock(_mutex);
+		return _cancelled;
+	}
+
+protected:
+	/** Called (in the layout thread) whenever progress is set. */
+	virtual void progress_changed() {}
+
+private:
+	mutable Glib::Mutex _mutex;
+	double              _progress;
+	bool                _cancelled;
+};
+
+
+/** Graphviz state kept between layouts with dot.
+ *
+ * The graphs from the last layout are kept, and the next layout only adds,
+ * removes, and changes what differs, rather than building everything again.
+ * There is a graph for each component laid out, found by the lowest item
+ * slot in it, and nodes are found by item slot (see SlotId::index()).
+ * A session may only be used by one call to layout() at a time.
+ */
+class DotSession : boost::noncopyable {
+public:
+	DotSession();
+	~DotSession();
+
+	/** Lay out @a graph with dot, updating the session graph for it.
+	 * See layout_dot(). */
+	bool layout(LayoutGraph& graph, LayoutProgress* progress, const std::string& filename);
+
+	/** Start a new layout.  Graphs not used from now until collect() are freed. */
+	void begin();
+
+	/** Free the graphs of components that were not laid out since begin(). */
+	void collect();
+
+private:
+	struct Impl;
+	Impl* _impl;
+};
+
+
+/** Lay out @a graph with @a engine, setting node positions.
+ *
+ * Each weakly connected part of the graph (counting partners as connected)
+ * is laid out separately, in parallel, and the parts are then packed
+ * together.  With LAYOUT_DOT the parts are laid out one at a time, since
+ * graphviz keeps global state and only one layout may run at once (in
+ * this or any other thread).  Returns false (leaving positions untouched) if @a progress was
+ * cancelled.  Safe to call from any thread.  If a @a session is given,
+ * layout with dot updates the graphs from the last layout in it.
+ */
+bool layout(LayoutGraph&    graph,
+            LayoutEngine    engine,
+            LayoutProgress* progress,
+            DotSession*     session=NULL);
+
+
+/** Lay out @a graph with graphviz dot, setting node positions.
+ *
+ * If @a filename is given, the laid out graph is also written there.
+ * Without a @a session, graphviz state is freed before returning.
+ * Returns false (leaving positions untouched) if graphviz is unavailable
+ * or @a progress was cancelled.  Safe to call from any thread.
+ */
+bool layout_dot(LayoutGraph&       graph,
+                LayoutProgress*    progress,
+                DotSession*        session=NULL,
+                const std::string& filename="");
+
+
+/** Lay out @a graph in ranks along the direction of flow, setting node positions.
+ *
+ * This is a Sugiyama style layout: cycles are broken, nodes are assigned
+ * ranks (respecting edge length hints), the order within ranks is chosen
+ * to reduce crossings, and finally nodes are positioned within ranks close
+ * to their neighbours.  Returns false if @a progress was cancelled.
+ */
+bool layout_layered(LayoutGraph& graph, LayoutProgress* progress);
+
+
+/** Lay out @a graph with forces, from the node positions it has, until it settles.
+ *
+ * Connected nodes are pulled together and all nodes pushed apart, which
+ * suits densely connected graphs with no real direction of flow.
+ * Returns false if @a progress was cancelled.  See ForceLayout.
+ */
+bool layout_force(LayoutGraph& graph, LayoutProgress* progress);
+
+
+/** Return the number of processors online. */
+unsigned num_processors();
+
+
+} // namespace FlowCanvas
+
+#endif // FLOWCANVAS_LAYOUT_HPP
@@ -26,6 +26,7 @@
 #include "flowcanvas/Canvas.hpp"
 #include "flowcanvas/Item.hpp"
 #include "flowcanvas/Module.hpp"
+#include "TextMetrics.hpp"
 
 using std::list;
 using std::string;
@@ -73,6 +74,8 @@ Module::Module(
 	, _title_visible(show_title)
 	, _port_renamed(false)
 	, _show_port_labels(show_port_labels)
+	, _ports_moved(false)
+	, _port_extent(0.0)
 {
 	_module_box.property_fill_color_rgba() = MODULE_FILL_COLOUR;
 	_module_box.property_outline_color_rgba() = MODULE_OUTLINE_COLOUR;
@@ -89,8 +92,7 @@ Module::Module(
 		//if (canvas->get_zoom() != 1.0)
 		zoom(canvas->get_zoom());
 		_canvas_title.property_fill_color_rgba() = MODULE_TITLE_COLOUR;
-		_title_width = _canvas_title.property_text_width();
-		_title_height = _canvas_title.property_text_height();
+		TextMetrics::get(_canvas_title, _name, _title_width, _title_height);
 	} else {
 		_canvas_title.hide();
 	}
@@ -102,6 +104,13 @@ Module::Module(
 
 Module::~Module()
 {
+	boost::shared_ptr<Canvas> canvas = _canvas.lock();
+	if (canvas) {
+		canvas->forget_updates(this);
+		for (PortVector::iterator p = _ports.begin(); p != _ports.end(); ++p)
+			canvas->unregister_port(p->get());
+	}
+
 	delete _stacked_border;
 	delete _icon_box;
 }
@@ -127,9 +136,11 @@ Module::on_event(GdkEvent* event)
 
 	bool ret = Item::on_event(event);
 
-	if (event->type == GDK_ENTER_NOTIFY)
-		for (PortVector::iterator p = _ports.begin(); p != _ports.end(); ++p)
-			(*p)->raise_connections();
+	if (event->type == GDK_ENTER_NOTIFY && (canvas = _canvas.lock())) {
+		const ConnectionSet& connections = canvas->item_connections(shared_from_this());
+		for (ConnectionSet::const_iterator c = connections.begin(); c != connections.end(); ++c)
+			(*c)->raise_to_top();
+	}
 
 	return ret;
 }
@@ -210,6 +221,34 @@ Module::zoom(double z)
 }
 
 
+/** Hide the title below full detail, and all but the box at minimal. */
+void
+Module::set_detail(DetailLevel level)
+{
+	if (_title_visible && level == DETAIL_FULL)
+		_canvas_title.show();
+	else
+		_canvas_title.hide();
+
+	if (_icon_box) {
+		if (level == DETAIL_MINIMAL)
+			_icon_box->hide();
+		else
+			_icon_box->show();
+	}
+
+	if (_stacked_border) {
+		if (level == DETAIL_MINIMAL)
+			_stacked_border->hide();
+		else
+			_stacked_border->show();
+	}
+
+	for (PortVector::iterator p = _ports.begin(); p != _ports.end(); ++p)
+		(*p)->set_detail(level);
+}
+
+
 void
 Module::set_highlighted(bool b)
 {
@@ -249,11 +288,28 @@ Module::set_selected(bool selected)
 boost::shared_ptr<Port>
 Module::port_at(double x, double y)
 {
+	boost::shared_ptr<Canvas> canvas = _canvas.lock();
+	if (!canvas)
+		return boost::shared_ptr<Port>();
+
+	const bool horizontal = (canvas->direction() == Canvas::HORIZONTAL);
+	if (_ports_moved)
+		index_port_positions(horizontal);
+
 	x -= property_x();
 	y -= property_y();
 
-	for (PortVector::iterator p = _ports.begin(); p != _ports.end(); ++p) {
-		boost::shared_ptr<Port> port = *p;
+	// Search back from the last port that starts before the point
+	const double pos = (horizontal ? y : x);
+	PortPositions::const_iterator i = std::upper_bound(
+		_port_positions.begin(), _port_positions.end(), pos, PortPositionLess());
+
+	while (i != _port_positions.begin()) {
+		--i;
+		if (i->first + _port_extent < pos)
+			break;
+
+		const boost::shared_ptr<Port>& port = i->second;
 		if (x > port->property_x() && x < port->property_x() + port->width()
 				&& y > port->property_y() && y < port->property_y() + port->height()) {
 			return port;
@@ -264,31 +320,59 @@ Module::port_at(double x, double y)
 }
 
 
+/** Sort ports by position along the axis ports are stacked on. */
+void
+Module::index_port_positions(bool horizontal)
+{
+	_port_positions.clear();
+	_port_positions.reserve(_ports.size());
+	_port_extent = 0.0;
+	for (PortVector::const_iterator p = _ports.begin(); p != _ports.end(); ++p) {
+		const boost::shared_ptr<Port>& port = *p;
+		if (horizontal) {
+			_port_positions.push_back(std::make_pair(double(port->property_y()), port));
+			_port_extent = std::max(_port_extent, port->height());
+		} else {
+			_port_positions.push_back(std::make_pair(double(port->property_x()), port));
+			_port_extent = std::max(_port_extent, port->width());
+		}
+	}
+
+	std::stable_sort(_port_positions.begin(), _port_positions.end(), PortPositionLess());
+	_ports_moved = false;
+}
+
+
 void
 Module::remove_port(boost::shared_ptr<Port> port)
 {
 	PortVector::iterator i = std::find(_ports.begin(), _ports.end(), port);
 
 	if (i != _ports.end()) {
+		const size_t index = i - _ports.begin();
+		_port_renamed_connections[index].disconnect();
+		_port_renamed_connections.erase(_port_renamed_connections.begin() + index);
+		_port_placements.erase(_port_placements.begin() + index);
 		_ports.erase(i);
-
-		// Find new widest input or output, if necessary
-		if (port->is_input() && port->width() >= _widest_input) {
-			_widest_input = 0;
-			for (PortVector::iterator i = _ports.begin(); i != _ports.end(); ++i) {
-				const boost::shared_ptr<Port> p = (*i);
-				if (p->is_input() && p->width() >= _widest_input)
-					_widest_input = p->width();
-			}
-		} else if (port->is_output() && port->width() >= _widest_output) {
-			_widest_output = 0;
-			for (PortVector::iterator i = _ports.begin(); i != _ports.end(); ++i) {
-				const boost::shared_ptr<Port> p = (*i);
-				if (p->is_output() && p->width() >= _widest_output)
-					_widest_output = p->width();
+		unindex_port(port);
+		_ports_moved = true;
+
+		// Remove connections to the port from the canvas
+		boost::shared_ptr<Canvas> canvas = _canvas.lock();
+		if (canvas) {
+			canvas->unregister_port(port.get());
+			const Connectable::Connections connections = port->connections(); // copy
+			for (Connectable::Connections::const_iterator c = connections.begin();
+					c != connections.end(); ++c) {
+				boost::shared_ptr<Connection> connection = c->lock();
+				if (connection)
+					canvas->remove_connection(connection);
 			}
 		}
 
+		uncount_port_width(port);
+		update_widest();
+
 		resize();
 		port->hide();
 		port.reset();
@@ -354,11 +438,14 @@ Module::move(double dx, double dy)
 	else if (new_y + _height > canvas->height())
 		dy = canvas->height() - property_y() - _height;
 
-	Gnome::Canvas::Group::move(dx, dy);
+	if (dx != 0.0 || dy != 0.0)
+		Gnome::Canvas::Group::move(dx, dy);
+
+	canvas->item_bounds_changed(this);
 
 	// Deal with moving the connection lines
 	for (PortVector::iterator p = _ports.begin(); p != _ports.end(); ++p)
-		(*p)->move_connections();
+		(*p)->module_moved(dx, dy);
 }
 
 
@@ -385,21 +472,12 @@ Module::move_to(double x, double y)
 	assert(x >= 0);
 	assert(y >= 0);
 
-	if (x + _width >= canvas->width() || y + _height >= canvas->height()) {
-		double x1, y1, x2, y2;
-		canvas->get_scroll_region(x1, y1, x2, y2);
-		canvas->set_scroll_region(x1, y1, std::max(x2, x + _width), std::max(y2, y + _height));
-	}
-
-	property_x() = x;
-	property_y() = y;
-
-	// Actually move (stupid gnomecanvas)
-	move(0, 0);
+	// Grow the canvas to fit (its scroll region is set once per update)
+	if (x + _width >= canvas->width() || y + _height >= canvas->height())
+		canvas->resize(std::max(canvas->width(), x + _width),
+		               std::max(canvas->height(), y + _height));
 
-	// Update any connection line positions
-	for (PortVector::iterator p = _ports.begin(); p != _ports.end(); ++p)
-		(*p)->move_connections();
+	move(x - property_x(), y - property_y());
 }
 
 
@@ -410,8 +488,7 @@ Module::set_name(const string& n)
 		string old_name = _name;
 		_name = n;
 		_canvas_title.property_text() = _name;
-		_title_width = _canvas_title.property_text_width();
-		_title_height = _canvas_title.property_text_height();
+		TextMetrics::get(_canvas_title, _name, _title_width, _title_height);
 		if (_title_visible)
 			resize();
 	}
@@ -432,19 +509,147 @@ Module::add_port(boost::shared_ptr<Port> p)
 	if (i != _ports.end()) // already added
 		return;            // so do nothing
 
-	if (p->is_input() && p->natural_width() > _widest_input)
-		_widest_input = p->width();
-	else if (p->is_output() && p->natural_width() > _widest_output)
-		_widest_output = p->width();
-
 	_ports.push_back(p);
+	_port_placements.push_back(PortPlacement());
+	index_port(p);
+	count_port_width(p);
+	update_widest();
+	_ports_moved = true;
 
 	boost::shared_ptr<Canvas> canvas = _canvas.lock();
-	if (canvas)
+	if (canvas) {
+		canvas->register_port(p);
+		if (canvas->detail_level() != DETAIL_FULL)
+			p->set_detail(canvas->detail_level());
 		p->signal_event().connect(
 			sigc::bind(sigc::mem_fun(canvas.get(), &Canvas::port_event), p));
+	}
+
+	_port_renamed_connections.push_back(p->signal_renamed.connect(sigc::bind(
+		sigc::mem_fun(this, &Module::on_port_renamed), boost::weak_ptr<Port>(p))));
+}
+
+
+/** Add @a port to the name index.
+ *
+ * If another port already has the same name it stays indexed, so get_port
+ * returns the first port added with a given name.
+ */
+void
+Module::index_port(boost::shared_ptr<Port> port)
+{
+	_port_names[port.get()] = port->name();
+	_ports_by_name.insert(std::make_pair(port->name(), port));
+}
+
+
+/** Remove @a port from the name index. */
+void
+Module::unindex_port(boost::shared_ptr<Port> port)
+{
+	PortNames::iterator n = _port_names.find(port.get());
+	if (n == _port_names.end())
+		return;
+
+	const string name = n->second;
+	_port_names.erase(n);
 
-	p->signal_renamed.connect(sigc::mem_fun(this, &Module::port_renamed));
+	PortsByName::iterator i = _ports_by_name.find(name);
+	if (i == _ports_by_name.end() || i->second != port)
+		return;
+
+	_ports_by_name.erase(i);
+
+	// Names are unique unless there are more ports than indexed names
+	if (_port_names.size() == _ports_by_name.size())
+		return;
+
+	// Index the next remaining port with the same name, if any
+	for (PortVector::const_iterator p = _ports.begin(); p != _ports.end(); ++p) {
+		if (*p != port && (*p)->name() == name) {
+			_ports_by_name.insert(std::make_pair(name, *p));
+			break;
+		}
+	}
+}
+
+
+void
+Module::on_port_renamed(boost::weak_ptr<Port> weak_port)
+{
+	boost::shared_ptr<Port> port = weak_port.lock();
+	if (port && _port_names.find(port.get()) != _port_names.end()) {
+		unindex_port(port);
+		index_port(port);
+
+		// The port has measured itself, so only its width needs recounting
+		uncount_port_width(port);
+		count_port_width(port);
+		update_widest();
+	}
+}
+
+
+/** Count the natural width of @a port towards the widest input or output. */
+void
+Module::count_port_width(boost::shared_ptr<Port> port)
+{
+	const double width = port->natural_width();
+	PortWidths& widths = port->is_input() ? _input_widths : _output_widths;
+	++widths[width];
+	_port_widths[port.get()] = width;
+}
+
+
+void
+Module::uncount_port_width(boost::shared_ptr<Port> port)
+{
+	PortWidthsByPort::iterator w = _port_widths.find(port.get());
+	if (w == _port_widths.end())
+		return;
+
+	PortWidths& widths = port->is_input() ? _input_widths : _output_widths;
+	PortWidths::iterator c = widths.find(w->second);
+	if (c != widths.end() && --c->second == 0)
+		widths.erase(c);
+
+	_port_widths.erase(w);
+}
+
+
+/** Move and size the port at @a index, if that changes its geometry.
+ *
+ * Returns true if the port changed (and its connections were moved).
+ */
+bool
+Module::place_port(size_t index, double x, double y, double width, double height)
+{
+	const boost::shared_ptr<Port>& p = _ports[index];
+	PortPlacement& placement = _port_placements[index];
+
+	if (placement.placed && placement.x == x && placement.y == y
+			&& p->width() == width && p->height() == height)
+		return false;
+
+	if (p->width() != width)
+		p->set_width(width);
+	if (p->height() != height)
+		p->set_height(height);
+
+	p->property_x() = x;
+	p->property_y() = y;
+	p->move_connections();
+
+	placement = PortPlacement(x, y);
+	return true;
+}
+
+
+void
+Module::update_widest()
+{
+	_widest_input  = _input_widths.empty()  ? 0.0 : _input_widths.rbegin()->first;
+	_widest_output = _output_widths.empty() ? 0.0 : _output_widths.rbegin()->first;
 }
 
 
@@ -508,33 +713,27 @@ Module::embed_size_request(Gtk::Requisition* r, bool force)
 void
 Module::measure_ports()
 {
-	_widest_input = 0.0;
-	_widest_output = 0.0;
+	_input_widths.clear();
+	_output_widths.clear();
+	_port_widths.clear();
 	for (PortVector::iterator pi = _ports.begin(); pi != _ports.end(); ++pi) {
 		const boost::shared_ptr<Port> p = (*pi);
 		p->show_label(_show_port_labels);
-		if (p->is_input()) {
-			_widest_input = 0.0;
-			for (PortVector::iterator pi = _ports.begin(); pi != _ports.end(); ++pi)
-				if ((*pi)->natural_width() > _widest_input)
-					_widest_input = (*pi)->natural_width();
-		} else {
-			_widest_output = 0.0;
-			for (PortVector::iterator pi = _ports.begin(); pi != _ports.end(); ++pi)
-				if ((*pi)->natural_width() > _widest_output)
-					_widest_output = (*pi)->natural_width();
-		}
+		count_port_width(p);
 	}
+	update_widest();
 }
 
 
 /** Resize the module to fit its contents best.
+ *
+ * If the canvas is in the middle of an update, this is done when it ends.
  */
 void
 Module::resize()
 {
 	boost::shared_ptr<Canvas> canvas = _canvas.lock();
-	if (!canvas)
+	if (!canvas || canvas->defer_resize(this))
 		return;
 
 	switch (canvas->direction()) {
@@ -641,29 +840,25 @@ Module::resize_horiz()
 	bool last_was_input = false;
 	double y = 0.0;
 	double h = 0.0;
-	for (PortVector::iterator pi = _ports.begin(); pi != _ports.end(); ++pi) {
-		const boost::shared_ptr<Port> p = (*pi);
+	for (size_t index = 0; index < _ports.size(); ++index) {
+		const boost::shared_ptr<Port>& p = _ports[index];
 		h = p->height();
 
 		if (p->is_input()) {
 			y = header_height + (i * (h + 1.0));
 			++i;
-			p->set_width(widest_in);
-			p->property_x() = -0.5;
-			p->property_y() = y;
+			if (place_port(index, -0.5, y, widest_in, h))
+				_ports_moved = true;
 			last_was_input = true;
 		} else {
 			if (!horiz || !last_was_input) {
 				y = header_height + (i * (h + 1.0));
 				++i;
 			}
-			p->set_width(widest_out);
-			p->property_x() = _width - p->width() + 0.5;
-			p->property_y() = y;
+			if (place_port(index, _width - widest_out + 0.5, y, widest_out, h))
+				_ports_moved = true;
 			last_was_input = false;
 		}
-
-		(*pi)->move_connections();
 	}
 
 	if (_ports.empty())
@@ -687,7 +882,7 @@ Module::resize_horiz()
 	}
 
 	// Make things actually move to their new locations (?!)
-	move(0, 0);
+	refresh_bounds();
 }
 
 
@@ -700,7 +895,7 @@ Module::resize_vert()
 	}
 
 	double width = (_title_visible
-		? _canvas_title.property_text_width() + 10.0
+		? TextMetrics::width(_canvas_title, _name) + 10.0
 		: 1.0);
 
 	if (_icon_box)
@@ -721,27 +916,24 @@ Module::resize_vert()
 	bool last_was_input = false;
 	double x = 0.0;
 	static const double PAD = 2.0;
-	for (PortVector::iterator pi = _ports.begin(); pi != _ports.end(); ++pi) {
-		const boost::shared_ptr<Port> p = (*pi);
-		p->set_width(MODULE_EMPTY_PORT_BREADTH);
-		p->set_height(MODULE_EMPTY_PORT_DEPTH);
+	for (size_t index = 0; index < _ports.size(); ++index) {
+		const boost::shared_ptr<Port>& p = _ports[index];
 		if (p->is_input()) {
 			x = PAD + (i * (MODULE_EMPTY_PORT_BREADTH + 1.0));
 			++i;
-			p->property_x() = x;
-			p->property_y() = -0.5;
+			if (place_port(index, x, -0.5, MODULE_EMPTY_PORT_BREADTH, MODULE_EMPTY_PORT_DEPTH))
+				_ports_moved = true;
 			last_was_input = true;
 		} else {
 			if (!last_was_input) {
 				x = PAD + (i * (MODULE_EMPTY_PORT_BREADTH + 1.0));
 				++i;
 			}
-			p->property_x() = x;
-			p->property_y() = height - p->height() + 0.5;
+			if (place_port(index, x, height - MODULE_EMPTY_PORT_DEPTH + 0.5,
+			               MODULE_EMPTY_PORT_BREADTH, MODULE_EMPTY_PORT_DEPTH))
+				_ports_moved = true;
 			last_was_input = false;
 		}
-
-		(*pi)->move_connections();
 	}
 
 	x += MODULE_EMPTY_PORT_BREADTH;
@@ -758,7 +950,7 @@ Module::resize_vert()
 	}
 
 	// Make things actually move to their new locations (?!)
-	move(0, 0);
+	refresh_bounds();
 }
 
 
@@ -797,6 +989,23 @@ Module::fit_canvas()
 }
 
 
+/** Update the canvas after a resize.
+ *
+ * Unlike move(0, 0) this does not move connections, ports that were placed
+ * somewhere new have already moved their own.
+ */
+void
+Module::refresh_bounds()
+{
+	boost::shared_ptr<Canvas> canvas = _canvas.lock();
+	if (!canvas)
+		return;
+
+	Gnome::Canvas::Group::move(0, 0);
+	canvas->item_bounds_changed(this);
+}
+
+
 void
 Module::select_tick()
 {
@@ -28,6 +28,7 @@
 #include "flowcanvas/Canvas.hpp"
 #include "flowcanvas/Module.hpp"
 #include "flowcanvas/Port.hpp"
+#include "TextMetrics.hpp"
 
 using std::cerr;
 using std::endl;
@@ -54,10 +55,13 @@ Port::Port(boost::shared_ptr<Module> module, const string& name, bool is_input,
 	, _menu(NULL)
 	, _control(NULL)
 	, _color(color)
+	, _detail(DETAIL_FULL)
 	, _is_input(is_input)
 	, _selected(false)
 	, _toggled(false)
-
+	, _point_valid(false)
+	, _horizontal(true)
+	, _detail_hidden(false)
 {
 	boost::shared_ptr<Canvas> canvas = module->canvas().lock();
 
@@ -109,7 +113,10 @@ Port::show_control()
 		//rect->property_outline_color_rgba() = 0xFFFFFF45;
 		rect->property_width_pixels() = 0;
 		rect->property_fill_color_rgba() = 0xFFFFFF80;
-		rect->show();
+		if (_detail == DETAIL_FULL)
+			rect->show();
+		else
+			rect->hide();
 		_control = new Control(rect);
 	}
 }
@@ -222,7 +229,7 @@ double
 Port::natural_width() const
 {
 	if (_label)
-		return _label->property_text_width();
+		return TextMetrics::width(*_label, _name);
 	else
 		return PORT_EMPTY_PORT_DEPTH; // Used by Canvas::resize_horiz only
 }
@@ -236,9 +243,10 @@ Port::set_name(const string& n)
 
 		// Reposition label
 		_label->property_text() = _name;
-		const double text_width = _label->property_text_width();
+		double text_width, text_height;
+		TextMetrics::get(*_label, _name, text_width, text_height);
 		_width = text_width + 6.0;
-		_height = _label->property_text_height();
+		_height = text_height;
 		_rect->property_x2() = _width;
 		_rect->property_y2() = _height;
 		if (_control) {
@@ -247,6 +255,7 @@ Port::set_name(const string& n)
 		}
 		_label->property_x() = (_width / 2.0) - 3.0;
 		_label->property_y() = (_height / 2.0);
+		_point_valid = false;
 
 		signal_renamed.emit();
 	}
@@ -261,6 +270,39 @@ Port::zoom(float z)
 }
 
 
+/** Hide the label and control below full detail, and everything at minimal. */
+void
+Port::set_detail(DetailLevel level)
+{
+	_detail = level;
+
+	if (_label) {
+		if (level == DETAIL_FULL)
+			_label->show();
+		else
+			_label->hide();
+	}
+
+	if (_control) {
+		if (level == DETAIL_FULL)
+			_control->rect->show();
+		else
+			_control->rect->hide();
+	}
+
+	// Only show the port again if it was hidden here
+	if (level == DETAIL_MINIMAL) {
+		if (!_detail_hidden && (GTK_OBJECT_FLAGS(gobj()) & GNOME_CANVAS_ITEM_VISIBLE)) {
+			hide();
+			_detail_hidden = true;
+		}
+	} else if (_detail_hidden) {
+		show();
+		_detail_hidden = false;
+	}
+}
+
+
 void
 Port::create_menu()
 {
@@ -295,15 +337,15 @@ Port::disconnect_all()
 	if (!module)
 		return;
 
-	list<boost::weak_ptr<Connection> > connections = _connections; // copy
-	for (list<boost::weak_ptr<Connection> >::iterator i = connections.begin(); i != connections.end(); ++i) {
+	const Connections connections = _connections; // copy
+	for (Connections::const_iterator i = connections.begin(); i != connections.end(); ++i) {
 		boost::shared_ptr<Connection> c = (*i).lock();
 		if (c) {
 			module->canvas().lock()->disconnect(c->source().lock(), c->dest().lock());
 		}
 	}
 
-	_connections.clear();
+	clear_connections();
 }
 
 
@@ -323,9 +365,10 @@ Port::show_label(bool b)
 
 		zoom(canvas->get_zoom());
 
-		const double text_width = _label->property_text_width();
+		double text_width, text_height;
+		TextMetrics::get(*_label, _name, text_width, text_height);
 		_width = text_width + 6.0;
-		_height = _label->property_text_height();
+		_height = text_height;
 		set_width(_width);
 		set_height(_height);
 		_label->property_x() = (_width / 2.0) - 3.0;
@@ -333,6 +376,8 @@ Port::show_label(bool b)
 		_label->property_fill_color_rgba() = 0xFFFFFFFF;
 
 		_label->raise_to_top();
+		if (_detail != DETAIL_FULL)
+			_label->hide();
 	} else {
 		delete _label;
 		_label = NULL;
@@ -351,6 +396,8 @@ Port::show_label(bool b)
 
 	if (_rect)
 		_rect->property_x2() = _rect->property_x1() + _width;
+
+	_point_valid = false;
 }
 
 
@@ -399,6 +446,19 @@ Port::set_highlighted(bool b, bool highlight_parent, bool highlight_connections,
 // should attach if this is it's source
 Gnome::Art::Point
 Port::src_connection_point()
+{
+	if (!_point_valid)
+		update_connection_point();
+
+	return _connection_point;
+}
+
+
+/** Find the attachment point and direction, which are cached until the port
+ * or its module changes (see move_connections()).
+ */
+void
+Port::update_connection_point()
 {
 	bool horizontal = true;
 	boost::shared_ptr<Module> m = module().lock();
@@ -420,7 +480,33 @@ Port::src_connection_point()
 
 	i2w(x, y); // convert to world-relative coords
 
-	return Gnome::Art::Point(x, y);
+	_connection_point = Gnome::Art::Point(x, y);
+	_horizontal       = horizontal;
+	_point_valid      = true;
+}
+
+
+/** Update connections after this port has been moved or resized. */
+void
+Port::move_connections()
+{
+	_point_valid = false;
+	Connectable::move_connections();
+}
+
+
+/** Update connections after the module has been moved by (@a dx, @a dy).
+ *
+ * The cached attachment point is translated rather than found again.
+ */
+void
+Port::module_moved(double dx, double dy)
+{
+	if (_point_valid)
+		_connection_point = Gnome::Art::Point(
+			_connection_point.get_x() + dx, _connection_point.get_y() + dy);
+
+	Connectable::move_connections();
 }
 
 
@@ -439,6 +525,7 @@ Port::set_width(double w)
 	if (_rect)
 		_rect->property_x2() = _rect->property_x2() + (w - _width);
 	_width = w;
+	_point_valid = false;
 	if (_control)
 		set_control(_control->value, false);
 }
@@ -452,21 +539,17 @@ Port::set_height(double h)
 	if (_control)
 		_control->rect->property_y2() = _control->rect->property_y1() + h - 0.5;
 	_height = h;
+	_point_valid = false;
 }
 
 
 Gnome::Art::Point
 Port::connection_point_vector(double dx, double dy)
 {
-	bool horizontal = true;
-	boost::shared_ptr<Module> m = module().lock();
-	if (m) {
-		boost::shared_ptr<Canvas> canvas = m->canvas().lock();
-		if (canvas)
-			horizontal = (canvas->direction() == Canvas::HORIZONTAL);
-	}
+	if (!_point_valid)
+		update_connection_point();
 
-	if (horizontal) {
+	if (_horizontal) {
 		return Gnome::Art::Point(dx, 0);
 	} else {
 		return Gnome::Art::Point(0, dy);
@@ -0,0 +1,273 @@
+/* This file is part of FlowCanvas.
+ * Copyright (C) 2007-2009 David Robillard <http://drobilla.net>
+ *
+ * FlowCanvas is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * FlowCanvas is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#ifndef FLOWCANVAS_SPATIALINDEX_HPP
+#define FLOWCANVAS_SPATIALINDEX_HPP
+
+#include <cstddef>
+#include <vector>
+
+#include <boost/unordered_map.hpp>
+#include <boost/utility.hpp>
+
+namespace FlowCanvas {
+
+
+/** An axis-aligned rectangle in world coordinates. */
+struct Box {
+	Box() : x1(0), y1(0), x2(0), y2(0) {}
+	Box(double ax1, double ay1, double ax2, double ay2)
+		: x1(ax1), y1(ay1), x2(ax2), y2(ay2) {}
+
+	inline bool contains(double x, double y) const {
+		return x >= x1 && x <= x2 && y >= y1 && y <= y2;
+	}
+
+	inline bool contains(const Box& b) const {
+		return b.x1 >= x1 && b.x2 <= x2 && b.y1 >= y1 && b.y2 <= y2;
+	}
+
+	inline bool strictly_contains(const Box& b) const {
+		return b.x1 > x1 && b.x2 < x2 && b.y1 > y1 && b.y2 < y2;
+	}
+
+	inline bool intersects(const Box& b) const {
+		return b.x1 <= x2 && b.x2 >= x1 && b.y1 <= y2 && b.y2 >= y1;
+	}
+
+	double x1, y1, x2, y2;
+};
+
+
+/** A quadtree of bounding boxes for fast point and area queries.
+ *
+ * Each element is stored in the deepest node that fully contains its box, so
+ * queries only visit nodes that overlap the query point or area.  Elements
+ * outside the root bounds are kept in the root.  Elements are not owned.
+ *
+ * Elements that straddle a midline stay in the node above it, and every
+ * query checks every element on its path, so queries are only logarithmic
+ * when most elements are small relative to the index bounds.
+ */
+template <typename T>
+class SpatialIndex : boost::noncopyable {
+public:
+	explicit SpatialIndex(const Box& bounds)
+		: _root(new Node(bounds, 0))
+	{}
+
+	~SpatialIndex() { delete _root; }
+
+	/** Add @a t with bounding box @a box, or move it there if present. */
+	void insert(T* t, const Box& box) {
+		remove(t);
+		insert_entry(_root, Entry(t, box));
+	}
+
+	/** Update the box of @a t, if it is in the index. */
+	void update(T* t, const Box& box) {
+		typename Locations::iterator l = _locations.find(t);
+		if (l == _locations.end())
+			return;
+
+		Node* const node = l->second;
+		if ((node == _root || node->bounds.contains(box)) && !node->child_containing(box)) {
+			node->find(t)->box = box; // still belongs in the same node
+		} else {
+			node->erase(t);
+			_locations.erase(l);
+			insert_entry(_root, Entry(t, box));
+		}
+	}
+
+	void remove(T* t) {
+		typename Locations::iterator l = _locations.find(t);
+		if (l != _locations.end()) {
+			l->second->erase(t);
+			_locations.erase(l);
+		}
+	}
+
+	bool contains(T* t) const { return _locations.find(t) != _locations.end(); }
+
+	/** Get the box of @a t.  Returns false if @a t is not in the index. */
+	bool get_box(T* t, Box& box) const {
+		typename Locations::const_iterator l = _locations.find(t);
+		if (l == _locations.end())
+			return false;
+
+		box = l->second->find(t)->box;
+		return true;
+	}
+
+	void clear() {
+		const Box bounds = _root->bounds;
+		delete _root;
+		_root = new Node(bounds, 0);
+		_locations.clear();
+	}
+
+	/** Change the root bounds, reinserting everything. */
+	void set_bounds(const Box& bounds) {
+		std::vector<Entry> entries;
+		_root->collect(entries);
+		delete _root;
+		_root = new Node(bounds, 0);
+		_locations.clear();
+		for (typename std::vector<Entry>::const_iterator e = entries.begin(); e != entries.end(); ++e)
+			insert_entry(_root, *e);
+	}
+
+	const Box& bounds() const { return _root->bounds; }
+
+	/** Append every element whose box contains the point (@a x, @a y). */
+	void find(double x, double y, std::vector<T*>& results) const {
+		_root->find(x, y, results);
+	}
+
+	/** Append every element whose box intersects @a area. */
+	void find(const Box& area, std::vector<T*>& results) const {
+		_root->find(area, results, false);
+	}
+
+	/** Append every element whose box is strictly inside @a area. */
+	void find_within(const Box& area, std::vector<T*>& results) const {
+		_root->find(area, results, true);
+	}
+
+private:
+	enum { MAX_ENTRIES = 8, MAX_DEPTH = 12 };
+
+	struct Entry {
+		Entry(T* t, const Box& b) : item(t), box(b) {}
+		T*  item;
+		Box box;
+	};
+
+	struct Node {
+		Node(const Box& b, unsigned d) : bounds(b), depth(d) {
+			children[0] = children[1] = children[2] = children[3] = NULL;
+		}
+
+		~Node() {
+			for (size_t i = 0; i < 4; ++i)
+				delete children[i];
+		}
+
+		Node* child_containing(const Box& box) const {
+			for (size_t i = 0; children[0] && i < 4; ++i)
+				if (children[i]->bounds.contains(box))
+					return children[i];
+			return NULL;
+		}
+
+		Entry* find(T* t) {
+			for (typename std::vector<Entry>::iterator e = entries.begin(); e != entries.end(); ++e)
+				if (e->item == t)
+					return &*e;
+			return NULL;
+		}
+
+		void erase(T* t) {
+			for (size_t i = 0; i < entries.size(); ++i) {
+				if (entries[i].item == t) {
+					entries[i] = entries.back();
+					entries.pop_back();
+					return;
+				}
+			}
+		}
+
+		void find(double x, double y, std::vector<T*>& results) const {
+			for (typename std::vector<Entry>::const_iterator e = entries.begin(); e != entries.end(); ++e)
+				if (e->box.contains(x, y))
+					results.push_back(e->item);
+
+			// A point on a midline is in (the closed bounds of) several children
+			for (size_t i = 0; children[0] && i < 4; ++i)
+				if (children[i]->bounds.contains(x, y))
+					children[i]->find(x, y, results);
+		}
+
+		void find(const Box& area, std::vector<T*>& results, bool within) const {
+			for (typename std::vector<Entry>::const_iterator e = entries.begin(); e != entries.end(); ++e)
+				if (within ? area.strictly_contains(e->box) : e->box.intersects(area))
+					results.push_back(e->item);
+			for (size_t i = 0; children[0] && i < 4; ++i)
+				if (children[i]->bounds.intersects(area))
+					children[i]->find(area, results, within);
+		}
+
+		void collect(std::vector<Entry>& results) const {
+			results.insert(results.end(), entries.begin(), entries.end());
+			for (size_t i = 0; children[0] && i < 4; ++i)
+				children[i]->collect(results);
+		}
+
+		void split() {
+			const double mid_x = (bounds.x1 + bounds.x2) / 2.0;
+			const double mid_y = (bounds.y1 + bounds.y2) / 2.0;
+			children[0] = new Node(Box(bounds.x1, bounds.y1, mid_x, mid_y), depth + 1);
+			children[1] = new Node(Box(mid_x, bounds.y1, bounds.x2, mid_y), depth + 1);
+			children[2] = new Node(Box(bounds.x1, mid_y, mid_x, bounds.y2), depth + 1);
+			children[3] = new Node(Box(mid_x, mid_y, bounds.x2, bounds.y2), depth + 1);
+		}
+
+		Box                bounds;
+		unsigned           depth;
+		std::vector<Entry> entries;
+		Node*              children[4];
+	};
+
+	void insert_entry(Node* node, const Entry& entry) {
+		for (Node* child; (child = node->child_containing(entry.box)); )
+			node = child;
+
+		if (!node->children[0] && node->entries.size() >= MAX_ENTRIES
+				&& node->depth < MAX_DEPTH) {
+			// Split and push down whatever fits in a child
+			node->split();
+			std::vector<Entry> entries;
+			entries.swap(node->entries);
+			for (typename std::vector<Entry>::const_iterator e = entries.begin(); e != entries.end(); ++e)
+				place(node, *e);
+
+			Node* const child = node->child_containing(entry.box);
+			place(child ? child : node, entry);
+		} else {
+			place(node, entry);
+		}
+	}
+
+	void place(Node* node, const Entry& entry) {
+		Node* const child = node->child_containing(entry.box);
+		if (child)
+			node = child;
+		node->entries.push_back(entry);
+		_locations[entry.item] = node;
+	}
+
+	typedef boost::unordered_map<T*, Node*> Locations;
+
+	Node*     _root;
+	Locations _locations; ///< Node each element is stored in
+};
+
+
+} // namespace FlowCanvas
+
+#endif // FLOWCANVAS_SPATIALINDEX_HPP
@@ -0,0 +1,89 @@
+/* This file is part of FlowCanvas.
+ * Copyright (C) 2007-2009 David Robillard <http://drobilla.net>
+ *
+ * FlowCanvas is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * FlowCanvas is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#include <string>
+#include <utility>
+
+#include <boost/functional/hash.hpp>
+#include <boost/unordered_map.hpp>
+
+#include "TextMetrics.hpp"
+
+using std::string;
+
+namespace FlowCanvas {
+
+
+namespace {
+
+struct Key {
+	Key(const string& t, int s, double z) : text(t), size(s), zoom(z) {}
+
+	inline bool operator==(const Key& k) const {
+		return size == k.size && zoom == k.zoom && text == k.text;
+	}
+
+	string text;
+	int    size; ///< Font size, in thousandths of a point
+	double zoom; ///< Canvas pixels per unit
+};
+
+struct KeyHash {
+	inline size_t operator()(const Key& k) const {
+		size_t seed = boost::hash_value(k.text);
+		boost::hash_combine(seed, k.size);
+		boost::hash_combine(seed, k.zoom);
+		return seed;
+	}
+};
+
+typedef boost::unordered_map<Key, std::pair<double, double>, KeyHash> Extents;
+
+/** Entries kept before the cache is emptied (a bound on memory use). */
+static const size_t MAX_ENTRIES = 8192;
+
+} // anonymous namespace
+
+
+void
+TextMetrics::get(Gnome::Canvas::Text& text,
+                 const string&        str,
+                 double&              width,
+                 double&              height)
+{
+	static Extents cache;
+
+	const Key key(str, text.property_size(), GNOME_CANVAS_ITEM(text.gobj())->canvas->pixels_per_unit);
+
+	Extents::const_iterator e = cache.find(key);
+	if (e != cache.end()) {
+		width  = e->second.first;
+		height = e->second.second;
+		return;
+	}
+
+	width  = text.property_text_width();
+	height = text.property_text_height();
+
+	if (cache.size() >= MAX_ENTRIES)
+		cache.clear();
+
+	cache.insert(std::make_pair(key, std::make_pair(width, height)));
+}
+
+
+} // namespace FlowCanvas
@@ -0,0 +1,53 @@
+/* This file is part of FlowCanvas.
+ * Copyright (C) 2007-2009 David Robillard <http://drobilla.net>
+ *
+ * FlowCanvas is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * FlowCanvas is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#ifndef FLOWCANVAS_TEXTMETRICS_HPP
+#define FLOWCANVAS_TEXTMETRICS_HPP
+
+#include <string>
+
+#include <libgnomecanvasmm.h>
+
+namespace FlowCanvas {
+
+
+/** Process-wide cache of text extents.
+ *
+ * Measuring a canvas text item lays it out with Pango, which is slow, and
+ * the same labels ("in", "out_L", ...) appear over and over, so extents are
+ * cached by text, font size, and zoom.  All text is assumed to use the
+ * default font family and weight.
+ */
+class TextMetrics {
+public:
+	/** Get the extents (in world units) of @a text, which must be displaying @a str. */
+	static void get(Gnome::Canvas::Text& text,
+	                const std::string&   str,
+	                double&              width,
+	                double&              height);
+
+	static double width(Gnome::Canvas::Text& text, const std::string& str) {
+		double width, height;
+		get(text, str, width, height);
+		return width;
+	}
+};
+
+
+} // namespace FlowCanvas
+
+#endif // FLOWCANVAS_TEXTMETRICS_HPP